@@ -1,20 +1,20 @@
-//#include <iostream>
-//#include <fstream>
-//#include <cstdio>
-//#include "huffman.hpp"
-//
-//using namespace std;
-//using namespace Huffman;
-//namespace fs = std::filesystem;
-//
-////int main()
-////{
-////	ofstream os{ "bbbbb.bin", ios_base::binary };
-////	Compress("bbbbb.txt", os);
-////}
-//
-//int main()
-//{
-//	ifstream is{ "bbbbb.bin", ios_base::binary };
-//	Decompress(is, fs::current_path());
+//#include <iostream>
+//#include <fstream>
+//#include <cstdio>
+//#include "huffman.hpp"
+//
+//using namespace std;
+//using namespace Huffman;
+//namespace fs = std::filesystem;
+//
+////int main()
+////{
+////	ofstream os{ "bbbbb.bin", ios_base::binary };
+////	Compress("bbbbb.txt", os);
+////}
+//
+//int main()
+//{
+//	ifstream is{ "bbbbb.bin", ios_base::binary };
+//	Decompress(is, fs::current_path());
 //}
\ No newline at end of file
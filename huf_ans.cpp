@@ -0,0 +1,359 @@
+#include "huf_ans.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#define IO_BUFFER_SIZE 0x10000
+
+using namespace std;
+
+namespace Huffman
+{
+
+static int HighBit(uint32_t value)
+{
+	int bit = 0;
+	while (value >>= 1)
+		bit++;
+	return bit;
+}
+
+vector<uint32_t> NormalizeAnsCounts(const vector<size_t>& token_table)
+{
+	vector<uint32_t> counts(Codec8::token_max);
+	uint64_t total = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		total += token_table[i];
+	if (!total)
+		return counts;
+
+	int64_t sum = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		if (!token_table[i])
+			continue;
+		counts[i] = max<uint32_t>(1, (uint32_t)llround((double)token_table[i] * ANS_TABLE_SIZE / total));
+		sum += counts[i];
+	}
+
+	// the rounding is made up one count at a time, where it costs the fewest bits
+	while (sum != ANS_TABLE_SIZE) {
+		int step = sum > ANS_TABLE_SIZE ? -1 : 1;
+		size_t best = 0;
+		double best_cost = numeric_limits<double>::infinity();
+
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (!counts[i] || counts[i] + step < 1)
+				continue;
+			double cost = token_table[i] * log2((double)counts[i] / (counts[i] + step));
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = i;
+			}
+		}
+		counts[best] += step;
+		sum += step;
+	}
+	return counts;
+}
+
+uint64_t EstimateAnsSize(const vector<size_t>& token_table, const vector<uint32_t>& counts, size_t token_count)
+{
+	double bits = 0;
+	size_t num_of_records = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		if (!counts[i])
+			continue;
+		bits += token_table[i] * (ANS_TABLE_LOG - log2((double)counts[i]));
+		num_of_records++;
+	}
+
+	// the state at the start of every chunk
+	bits += (double)ANS_TABLE_LOG * ((token_count + SYNC_INTERVAL - 1) / SYNC_INTERVAL);
+
+	return (uint64_t)(bits / BYTE_BITS) + 1 + sizeof(AnsRecord) * num_of_records;
+}
+
+// the positions of the tokens in the table of states, the same for the encoder and the decoder
+static vector<uint8_t> SpreadTokens(const vector<uint32_t>& counts)
+{
+	vector<uint8_t> spread(ANS_TABLE_SIZE);
+	const size_t step = (ANS_TABLE_SIZE >> 1) + (ANS_TABLE_SIZE >> 3) + 3; // odd, so every position is reached once
+	size_t pos = 0;
+
+	for (size_t token = 0; token < counts.size(); token++) {
+		for (uint32_t n = 0; n < counts[token]; n++) {
+			spread[pos] = (uint8_t)token;
+			pos = (pos + step) & (ANS_TABLE_SIZE - 1);
+		}
+	}
+	return spread;
+}
+
+// Encoder states are [ANS_TABLE_SIZE, 2 * ANS_TABLE_SIZE), the state of the decoder is that minus ANS_TABLE_SIZE.
+// A token of count n is coded by writing the low bits of the state until it is in [n, 2n),
+// and taking the state of that position among the positions of the token.
+class AnsEncoder
+{
+public:
+	explicit AnsEncoder(const vector<uint32_t>& counts)
+		: symbols(counts.size()), next_states(ANS_TABLE_SIZE)
+	{
+		uint32_t first = 0;
+		for (size_t token = 0; token < counts.size(); token++) {
+			if (!counts[token])
+				continue;
+			int num_of_bits = ANS_TABLE_LOG - HighBit(counts[token]);
+			symbols[token] = { counts[token] << num_of_bits, num_of_bits, first, counts[token] };
+			first += counts[token];
+		}
+
+		vector<uint8_t> spread = SpreadTokens(counts);
+		vector<uint32_t> used(counts.size());
+		for (uint32_t pos = 0; pos < ANS_TABLE_SIZE; pos++) {
+			uint8_t token = spread[pos];
+			next_states[symbols[token].first + used[token]++] = ANS_TABLE_SIZE + pos;
+		}
+	}
+
+	// the tokens are coded from the last one, and their bits are written in the order the decoder reads them
+	template <typename Write>
+	void EncodeChunk(const uint8_t* tokens, size_t size, Write write)
+	{
+		uint32_t state = ANS_TABLE_SIZE;
+		emitted.clear();
+
+		for (size_t n = size; n--;) {
+			const Symbol& symbol = symbols[tokens[n]];
+			int num_of_bits = symbol.num_of_bits - (state < symbol.threshold);
+			emitted.push_back((state & ((1u << num_of_bits) - 1)) << BYTE_BITS | num_of_bits);
+			state = next_states[symbol.first + (state >> num_of_bits) - symbol.count];
+		}
+
+		write(state - ANS_TABLE_SIZE, ANS_TABLE_LOG);
+		for (size_t n = emitted.size(); n--;)
+			write(emitted[n] >> BYTE_BITS, emitted[n] & 0xff);
+	}
+
+private:
+	struct Symbol
+	{
+		uint32_t threshold; // fewer bits are written below it
+		int num_of_bits;
+		uint32_t first; // in next_states
+		uint32_t count;
+	};
+
+	vector<Symbol> symbols;
+	vector<uint32_t> next_states; // by token, then by the state reduced to [n, 2n)
+	vector<uint32_t> emitted; // bits << BYTE_BITS | number of bits
+};
+
+void EncodeAns(istream& is, ostream& os, const vector<uint32_t>& counts, size_t token_count)
+{
+	vector<AnsRecord> records;
+	for (size_t token = 0; token < counts.size(); token++)
+		if (counts[token])
+			records.push_back({ (uint8_t)token, (uint16_t)counts[token] });
+
+	HufHeader header{};
+	header.token_mode = TOKEN_MODE_8;
+	header.ans = 1;
+	header.records_size = (uint32_t)records.size();
+	header.token_count = token_count;
+	header.sync_interval = SYNC_INTERVAL;
+	auto header_pos = os.tellp();
+	os.write((char*)&header, sizeof(HufHeader));
+	os.write((char*)records.data(), sizeof(AnsRecord) * records.size());
+
+	// space for sync points
+	vector<uint64_t> sync_points(GetNumOfSyncPoints(header));
+	auto sync_pos = os.tellp();
+	os.write((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size());
+	sync_points.clear();
+
+	auto data_pos = os.tellp();
+	AnsEncoder encoder{ counts };
+	vector<uint8_t> chunk(header.sync_interval);
+	vector<char> out_buffer(IO_BUFFER_SIZE + sizeof(uint64_t));
+	size_t out_size = 0;
+	uint64_t num_of_bytes = 0; // written to os
+	uint64_t bits = 0;
+	int num_of_bits = 0;
+
+	auto write = [&](uint32_t value, int size) {
+		bits |= (uint64_t)value << num_of_bits;
+		num_of_bits += size;
+		while (num_of_bits >= BYTE_BITS) {
+			out_buffer[out_size++] = (char)bits;
+			bits >>= BYTE_BITS;
+			num_of_bits -= BYTE_BITS;
+		}
+		if (out_size >= IO_BUFFER_SIZE) {
+			os.write(out_buffer.data(), out_size);
+			num_of_bytes += out_size;
+			out_size = 0;
+		}
+	};
+
+	for (bool first_chunk = true; is.read((char*)chunk.data(), chunk.size()) || is.gcount(); first_chunk = false) {
+		if (!first_chunk)
+			sync_points.push_back((num_of_bytes + out_size) * BYTE_BITS + num_of_bits);
+		encoder.EncodeChunk(chunk.data(), is.gcount(), write);
+	}
+
+	if (num_of_bits)
+		out_buffer[out_size++] = (char)bits;
+	os.write(out_buffer.data(), out_size);
+	header.padding_bits = (BYTE_BITS - num_of_bits) % BYTE_BITS;
+
+	auto last_pos = os.tellp();
+	header.data_size = last_pos - data_pos;
+
+	os.seekp(header_pos);
+	os.write((char*)&header, sizeof(HufHeader));
+	os.seekp(sync_pos);
+	os.write((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size());
+	os.seekp(last_pos);
+}
+
+AnsDecoder::AnsDecoder(istream& is, const HufHeader& header)
+	: table(ANS_TABLE_SIZE), sync_interval{ header.sync_interval ? header.sync_interval : numeric_limits<size_t>::max() }
+{
+	vector<AnsRecord> records(header.records_size);
+	if (!is.read((char*)records.data(), sizeof(AnsRecord) * records.size()))
+		throw runtime_error{ "Invalid file header: ANS records are truncated" };
+
+	vector<uint32_t> counts(Codec8::token_max);
+	uint32_t sum = 0;
+	for (const AnsRecord& record : records) {
+		if (!record.count || counts[record.token])
+			throw out_of_range{ "Invalid file header: Invalid ANS records" };
+		counts[record.token] = record.count;
+		sum += record.count;
+	}
+	if (sum != ANS_TABLE_SIZE && (sum || header.token_count))
+		throw out_of_range{ "Invalid file header: Invalid ANS records" };
+
+	vector<uint8_t> spread = SpreadTokens(counts);
+	for (uint32_t pos = 0; pos < ANS_TABLE_SIZE; pos++) {
+		uint8_t token = spread[pos];
+		uint32_t next = counts[token]++; // [n, 2n) in the order of the positions
+		int num_of_bits = ANS_TABLE_LOG - HighBit(next);
+		table[pos] = { (uint16_t)((next << num_of_bits) - ANS_TABLE_SIZE), token, (uint8_t)num_of_bits };
+	}
+}
+
+void AnsDecoder::Decode(const char* data, size_t size, int first_bit, size_t& byte_count, size_t& skip_count, ostream& os)
+{
+	out_buffer.resize(IO_BUFFER_SIZE);
+	char* out = out_buffer.data();
+	size_t out_size = 0;
+	const Entry* entries = table.data();
+
+	// kept in locals, the stores to out could change them otherwise
+	size_t bytes_left = byte_count;
+	size_t skip_left = skip_count;
+	size_t tokens_left = chunk_left;
+	uint32_t current = state;
+	uint64_t in_bits = bits;
+	int in_size = num_of_bits;
+
+	for (size_t n = 0; n < size && bytes_left; n++) {
+		in_bits |= (uint64_t)((unsigned char)data[n] >> first_bit) << in_size;
+		in_size += BYTE_BITS - first_bit;
+		first_bit = 0;
+
+		// a token takes at most ANS_TABLE_LOG bits, the bits are used when there are enough for a few
+		if (in_size < 32 && n + 1 < size)
+			continue;
+
+		while (bytes_left) {
+			if (!tokens_left) {
+				if (in_size < ANS_TABLE_LOG)
+					break;
+				current = (uint32_t)in_bits & (ANS_TABLE_SIZE - 1);
+				in_bits >>= ANS_TABLE_LOG;
+				in_size -= ANS_TABLE_LOG;
+				tokens_left = sync_interval;
+			}
+
+			const Entry& entry = entries[current];
+			if (in_size < entry.num_of_bits)
+				break;
+			current = entry.base + (uint32_t)(in_bits & ((1u << entry.num_of_bits) - 1));
+			in_bits >>= entry.num_of_bits;
+			in_size -= entry.num_of_bits;
+			tokens_left--;
+
+			if (skip_left) {
+				skip_left--;
+				continue;
+			}
+			out[out_size++] = (char)entry.token;
+			if (out_size == IO_BUFFER_SIZE) {
+				os.write(out, out_size);
+				out_size = 0;
+			}
+			bytes_left--;
+		}
+	}
+	os.write(out, out_size);
+
+	byte_count = bytes_left;
+	skip_count = skip_left;
+	chunk_left = tokens_left;
+	state = current;
+	bits = in_bits;
+	num_of_bits = in_size;
+}
+
+void DecodeAns(istream& is, ostream& os, const HufHeader& header, size_t first, size_t count)
+{
+	AnsDecoder decoder{ is, header };
+
+	vector<uint64_t> sync_points(GetNumOfSyncPoints(header));
+	if (!is.read((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size()))
+		throw runtime_error{ "Invalid file header: sync points are truncated" };
+
+	size_t decoded_size = GetDecodedSize(header);
+	first = min(first, decoded_size);
+	count = min(count, decoded_size - first);
+
+	// nearest sync point before first
+	size_t sync_index = header.sync_interval ? min<size_t>(first / header.sync_interval, sync_points.size()) : 0;
+	uint64_t bit_offset = sync_index ? sync_points[sync_index - 1] : 0;
+	size_t skip_count = first - sync_index * (size_t)header.sync_interval;
+
+	if (bit_offset / BYTE_BITS > header.data_size)
+		throw out_of_range{ "Invalid file header: Invalid sync point" };
+
+	// only a range seeks, the whole data is read as it is
+	uint64_t data_left = header.data_size;
+	if (bit_offset / BYTE_BITS) {
+		is.seekg(bit_offset / BYTE_BITS, ios_base::cur);
+		data_left -= bit_offset / BYTE_BITS;
+	}
+
+	vector<char> in_buffer(IO_BUFFER_SIZE);
+	int first_bit = bit_offset % BYTE_BITS;
+
+	while (data_left && count) {
+		size_t in_size = (size_t)min<uint64_t>(data_left, in_buffer.size());
+		if (!is.read(in_buffer.data(), in_size))
+			throw runtime_error{ "Invalid file: compressed data is truncated" };
+		data_left -= in_size;
+
+		decoder.Decode(in_buffer.data(), in_size, first_bit, count, skip_count, os);
+		first_bit = 0;
+	}
+
+	if (count)
+		throw runtime_error{ "Invalid file: compressed data is truncated" };
+
+	// the rest of the data is not needed (range)
+	if (data_left)
+		is.seekg(data_left, ios_base::cur);
+}
+
+}
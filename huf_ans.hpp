@@ -0,0 +1,76 @@
+#ifndef HUF_ANS_H
+#define HUF_ANS_H
+
+#include <stdint.h>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "huffman.hpp"
+
+// the counts of a table sum to ANS_TABLE_SIZE, a token of count n costs ANS_TABLE_LOG - log2(n) bits
+#define ANS_TABLE_LOG 12
+#define ANS_TABLE_SIZE (1 << ANS_TABLE_LOG)
+
+namespace Huffman
+{
+
+#pragma pack(push, 1)
+
+// ANS data: HufHeader (ans, records_size: number of records), ANS records, sync points, data
+// the data of every sync_interval tokens starts with the state (ANS_TABLE_LOG bits), so a sync point starts a chunk
+struct AnsRecord
+{
+	uint8_t token;
+	uint16_t count; // normalized, at least 1
+};
+
+#pragma pack(pop)
+
+// Table-based asymmetric numeral systems for 8 bit tokens. A token of probability p costs about -log2(p) bits
+// instead of a whole number of bits, which pays on skewed tokens where Huffman gives the most common one a whole bit.
+
+// normalized counts of the tokens of token_table (Codec8), 0 for the tokens that do not appear
+std::vector<uint32_t> NormalizeAnsCounts(const std::vector<size_t>& token_table);
+
+// bytes of the records and the data of EncodeAns
+uint64_t EstimateAnsSize(const std::vector<size_t>& token_table, const std::vector<uint32_t>& counts, size_t token_count);
+
+// same as Encode, with the ANS table of counts
+void EncodeAns(std::istream& src, std::ostream& dst, const std::vector<uint32_t>& counts, size_t token_count);
+
+// Decoding tables and the state of the data decoded so far, for data given in pieces
+class AnsDecoder
+{
+public:
+	// src: right after the HufHeader, the records are read from it but not the sync points
+	AnsDecoder(std::istream& src, const HufHeader& header);
+
+	// same as CodecContext::DecodeBits
+	void Decode(const char* data, size_t size, int first_bit, size_t& byte_count, size_t& skip_count, std::ostream& dst);
+
+private:
+	struct Entry
+	{
+		uint16_t base; // next state without the bits read
+		uint8_t token;
+		uint8_t num_of_bits;
+	};
+
+	std::vector<Entry> table;
+	size_t sync_interval;
+	size_t chunk_left = 0; // tokens before the state of the next chunk
+	uint32_t state = 0;
+	uint64_t bits = 0; // read but not used yet
+	int num_of_bits = 0;
+	std::vector<char> out_buffer;
+};
+
+// src: right after the HufHeader, left at the end of the data
+// writes bytes [first, first + count), starting from the nearest sync point
+void DecodeAns(std::istream& src, std::ostream& dst, const HufHeader& header, size_t first = 0,
+			   size_t count = std::numeric_limits<size_t>::max());
+
+}
+
+#endif // HUF_ANS_H
@@ -0,0 +1,223 @@
+#include "huf_cache.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+#define CACHE_INDEX "index"
+#define CACHE_BLOBS "blobs"
+#define CACHE_NEW_SUFFIX ".new"
+#define COPY_BUFFER_SIZE 0x10000
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+static void CopyStream(istream& is, ostream& os, uint64_t size)
+{
+	char buffer[COPY_BUFFER_SIZE];
+
+	while (size) {
+		streamsize len = (streamsize)min<uint64_t>(size, COPY_BUFFER_SIZE);
+		if (!is.read(buffer, len))
+			throw runtime_error{ "Invalid cache: blob is truncated" };
+		os.write(buffer, len);
+		size -= len;
+	}
+}
+
+static uint64_t GetInode(const fs::path& path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	struct stat st;
+	if (!stat(path.c_str(), &st))
+		return st.st_ino;
+#endif
+	return 0;
+}
+
+static std::filesystem::path::string_type GetKey(const fs::path& file_path)
+{
+	auto key = fs::absolute(file_path).lexically_normal().native();
+	if (key.size() >= FILENAME_MAX)
+		throw out_of_range{ "Invalid file name length: " + to_string(key.size()) };
+	return key;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+	auto bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t HashStream(istream& is)
+{
+	auto first_pos = is.tellg();
+	char buffer[COPY_BUFFER_SIZE];
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	while (is.read(buffer, COPY_BUFFER_SIZE) || is.gcount())
+		hash = HashBytes(buffer, (size_t)is.gcount(), hash);
+
+	is.clear();
+	is.seekg(first_pos);
+	return hash;
+}
+
+RecompressCache::RecompressCache(const fs::path& cache_dir)
+	: dir{ cache_dir }
+{
+	fs::create_directories(dir);
+	LoadIndex();
+
+	new_blobs.open(dir / CACHE_BLOBS CACHE_NEW_SUFFIX, ios_base::in | ios_base::out | ios_base::trunc | ios_base::binary);
+	if (!new_blobs.good()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "RecompressCache", dir / CACHE_BLOBS CACHE_NEW_SUFFIX, ec };
+	}
+}
+
+RecompressCache::~RecompressCache()
+{
+	// not saved: discard this run
+	if (new_blobs.is_open()) {
+		new_blobs.close();
+		error_code ec;
+		fs::remove(dir / CACHE_BLOBS CACHE_NEW_SUFFIX, ec);
+	}
+}
+
+void RecompressCache::LoadIndex()
+{
+	ifstream index{ dir / CACHE_INDEX, ios_base::binary };
+	old_blobs.open(dir / CACHE_BLOBS, ios_base::binary);
+	if (!index.good() || !old_blobs.good())
+		return;
+
+	// a cache of another format is dropped, it only costs a full recompression
+	CacheIndexHeader header{};
+	if (!index.read((char*)&header, sizeof(CacheIndexHeader)) || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION)
+		return;
+
+	error_code ec;
+	uint64_t blobs_size = fs::file_size(dir / CACHE_BLOBS, ec);
+
+	CacheRecord record;
+	NameType name[FILENAME_MAX];
+	while (index.read((char*)&record, sizeof(CacheRecord))) {
+		if (ec || record.path_size >= FILENAME_MAX ||
+				record.blob_offset + record.blob_size > blobs_size ||
+				!index.read((char*)name, sizeof(NameType) * record.path_size)) {
+			// a broken cache only costs a full recompression
+			old_records.clear();
+			return;
+		}
+		old_records[NameString(name, record.path_size)] = record;
+	}
+}
+
+bool RecompressCache::IsUnchanged(const CacheRecord& old_record, CacheRecord& record, istream& is)
+{
+	if (old_record.file_size != record.file_size || old_record.token_mode != record.token_mode ||
+			old_record.adaptive != record.adaptive || old_record.lz77_level != record.lz77_level)
+		return false;
+
+	if (old_record.mtime == record.mtime && old_record.inode == record.inode) {
+		record.content_hash = old_record.content_hash;
+		return true;
+	}
+
+	// touched or moved, but the content may be the same
+	record.content_hash = HashStream(is);
+	return record.content_hash == old_record.content_hash;
+}
+
+void RecompressCache::Encoding(const fs::path& file_path, istream& is, ostream& os, const EncodingOptions& options)
+{
+	CacheRecord record{};
+	record.token_mode = options.token_mode;
+	record.adaptive = options.adaptive;
+	record.lz77_level = options.lz77_level;
+	// bytes of src, which are only the data of a sparse file
+	auto first_pos = is.tellg();
+	is.seekg(0, ios_base::end);
+	record.file_size = (uint64_t)(is.tellg() - first_pos);
+	is.seekg(first_pos);
+	record.mtime = fs::last_write_time(file_path).time_since_epoch().count();
+	record.inode = GetInode(file_path);
+
+	NameString key = GetKey(file_path);
+	record.path_size = (uint16_t)key.size();
+
+	auto old_iter = old_records.find(key);
+	bool unchanged = old_iter != old_records.end() && IsUnchanged(old_iter->second, record, is);
+
+	record.blob_offset = new_blobs.tellp();
+	if (unchanged) {
+		record.blob_size = old_iter->second.blob_size;
+		old_blobs.seekg(old_iter->second.blob_offset);
+		CopyStream(old_blobs, new_blobs, record.blob_size);
+		num_of_hits++;
+	}
+	else {
+		if (!record.content_hash)
+			record.content_hash = HashStream(is);
+		Huffman::Encoding(is, new_blobs, options);
+		record.blob_size = (uint64_t)new_blobs.tellp() - record.blob_offset;
+		num_of_misses++;
+	}
+
+	new_blobs.seekg(record.blob_offset);
+	CopyStream(new_blobs, os, record.blob_size);
+	new_blobs.seekp(0, ios_base::end);
+
+	new_records[key] = record;
+}
+
+void RecompressCache::Keep(const fs::path& file_path)
+{
+	NameString key = GetKey(file_path);
+	auto old_iter = old_records.find(key);
+	if (old_iter == old_records.end() || new_records.count(key))
+		return;
+
+	// an entry that no longer matches the file is a miss in the next run, as in this one
+	CacheRecord record = old_iter->second;
+	record.blob_offset = new_blobs.tellp();
+	old_blobs.seekg(old_iter->second.blob_offset);
+	CopyStream(old_blobs, new_blobs, record.blob_size);
+
+	new_records[key] = record;
+}
+
+void RecompressCache::Save()
+{
+	fs::path index_path = dir / CACHE_INDEX;
+	fs::path new_index_path = dir / CACHE_INDEX CACHE_NEW_SUFFIX;
+	{
+		ofstream index{ new_index_path, ios_base::binary };
+		if (!index.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "RecompressCache::Save", new_index_path, ec };
+		}
+		CacheIndexHeader header{ CACHE_MAGIC, CACHE_VERSION };
+		index.write((char*)&header, sizeof(CacheIndexHeader));
+		for (const auto& [key, record] : new_records) {
+			index.write((char*)&record, sizeof(CacheRecord));
+			index.write((char*)key.c_str(), sizeof(NameType) * key.size());
+		}
+	}
+
+	old_blobs.close();
+	new_blobs.close();
+	fs::rename(dir / CACHE_BLOBS CACHE_NEW_SUFFIX, dir / CACHE_BLOBS);
+	fs::rename(new_index_path, index_path);
+}
+
+}
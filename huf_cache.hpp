@@ -0,0 +1,100 @@
+#ifndef HUF_CACHE_H
+#define HUF_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+// FNV-1a
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// the index starts with CacheIndexHeader. CACHE_VERSION changes with the archive format or CacheRecord,
+// so the blobs of an older format are never copied into an archive
+#define CACHE_MAGIC 0x5844494348465548ULL // "HUFHCIDX"
+#define CACHE_VERSION 1
+
+namespace Huffman
+{
+
+#pragma pack(push, 1)
+
+struct CacheIndexHeader
+{
+	uint64_t magic;
+	uint32_t version;
+};
+
+struct CacheRecord
+{
+	uint64_t file_size; // bytes given to Encoding, the data of a sparse file
+	int64_t mtime;
+	uint64_t inode; // 0 if the platform does not provide it
+	uint64_t content_hash;
+	uint64_t blob_offset;
+	uint64_t blob_size;
+	// EncodingOptions of the blob
+	uint8_t token_mode;
+	uint8_t adaptive;
+	uint8_t lz77_level;
+	uint16_t path_size; // followed by path (NameType * path_size)
+};
+
+#pragma pack(pop)
+
+// Sidecar cache of encoded entries, keyed by file metadata.
+// cache_dir/index holds the records and cache_dir/blobs holds the output of Encoding for each file.
+// Only the entries used or kept in the current run are kept when Save is called.
+class RecompressCache
+{
+public:
+	explicit RecompressCache(const std::filesystem::path& cache_dir);
+	~RecompressCache();
+
+	RecompressCache(const RecompressCache&) = delete;
+	RecompressCache& operator=(const RecompressCache&) = delete;
+
+	// same as Encoding, but copies the previous result if file_path is unchanged
+	void Encoding(const std::filesystem::path& file_path, std::istream& src, std::ostream& dst,
+				  const EncodingOptions& options = {});
+
+	// keeps the entry of file_path from the last save as if it was used in this run,
+	// for a file of the archive written before the checkpoint the run goes on from
+	void Keep(const std::filesystem::path& file_path);
+
+	void Save();
+
+	size_t hits() const {
+		return num_of_hits;
+	}
+	size_t misses() const {
+		return num_of_misses;
+	}
+
+private:
+	using NameString = std::filesystem::path::string_type;
+
+	void LoadIndex();
+	bool IsUnchanged(const CacheRecord& old_record, CacheRecord& record, std::istream& src);
+
+	std::filesystem::path dir;
+	std::unordered_map<NameString, CacheRecord> old_records;
+	std::unordered_map<NameString, CacheRecord> new_records;
+	std::ifstream old_blobs;
+	std::fstream new_blobs;
+	size_t num_of_hits = 0;
+	size_t num_of_misses = 0;
+};
+
+// hash: FNV_OFFSET_BASIS, or the result of the last call to go on with it
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS);
+
+uint64_t HashStream(std::istream& is);
+
+}
+
+#endif // HUF_CACHE_H
@@ -0,0 +1,203 @@
+#include "huf_checkpoint.hpp"
+#include "huf_walker.hpp"
+#include "huf_cache.hpp"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define CHECKPOINT_NEW_SUFFIX ".new"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+// the written data of the file reaches the disk before the journal that counts on it
+static void SyncFile(const fs::path& file_path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	int fd = open(file_path.c_str(), O_RDONLY);
+	if (fd < 0 || fsync(fd)) {
+		if (fd >= 0)
+			close(fd);
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "SyncFile", file_path, ec };
+	}
+	close(fd);
+#endif
+}
+
+// sizes of files are left out, a file growing before it is written does not change the job
+static uint64_t HashJob(const Manifest& manifest, const CompressOptions& options)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	auto add = [&](uint64_t value) { hash = HashBytes(&value, sizeof(uint64_t), hash); };
+
+	// an archive of another layout is not written on
+	add(ARCHIVE_VERSION);
+	add((uint64_t)options.token_mode);
+	add(options.adaptive);
+	add((uint64_t)options.lz77_level);
+	add(options.solid);
+	add(manifest.size());
+	for (const auto& entry : manifest) {
+		const auto& path = entry.path.native();
+		add(path.size());
+		hash = HashBytes(path.data(), sizeof(NameType) * path.size(), hash);
+		add(entry.type);
+		add(entry.num_of_children);
+	}
+	return hash;
+}
+
+Checkpoint::Checkpoint(const fs::path& archive_path, const fs::path& journal_path, unsigned interval)
+	: archive_path{ archive_path }, journal_path{ journal_path }, interval{ interval } {}
+
+bool Checkpoint::Load(const Manifest& manifest, const CompressOptions& options)
+{
+	job_hash = HashJob(manifest, options);
+	manifest_size = manifest.size();
+	last_save = chrono::steady_clock::now();
+
+	if (!LoadJournal(manifest.size())) {
+		num_of_entries = 0;
+		archive_size = 0;
+		frames.clear();
+		return false;
+	}
+
+	// the bytes after the last save are of entries that are written again
+	fs::resize_file(archive_path, archive_size);
+	return true;
+}
+
+bool Checkpoint::LoadJournal(size_t manifest_size)
+{
+	error_code journal_ec, archive_ec;
+	uint64_t journal_size = fs::file_size(journal_path, journal_ec);
+	uint64_t file_size = fs::file_size(archive_path, archive_ec);
+	if (journal_ec || archive_ec)
+		return false;
+
+	ifstream journal{ journal_path, ios_base::binary };
+	CheckpointRecord record{};
+	if (!journal.read((char*)&record, sizeof(CheckpointRecord)) || record.job_hash != job_hash ||
+		record.num_of_entries > manifest_size || record.archive_size > file_size || record.num_of_frames > manifest_size)
+		return false;
+
+	ifstream archive{ archive_path, ios_base::binary };
+	uint64_t last_pos = 0;
+
+	for (uint32_t i = 0; i < record.num_of_frames; i++) {
+		CheckpointFrame saved{};
+		if (!journal.read((char*)&saved, sizeof(CheckpointFrame)) || saved.num_of_solid_files > manifest_size)
+			return false;
+
+		DirectoryFrame frame{ (streamoff)saved.header_pos, saved.header, (size_t)saved.remaining, {}, saved.solid_size };
+		for (uint32_t k = 0; k < saved.num_of_solid_files; k++) {
+			uint32_t path_size = 0;
+			if (!journal.read((char*)&path_size, sizeof(uint32_t)) || path_size > journal_size)
+				return false;
+			fs::path::string_type path(path_size, 0);
+			if (!journal.read((char*)path.data(), sizeof(NameType) * path_size))
+				return false;
+			frame.solid_files.push_back(move(path));
+		}
+
+		// the header of an open directory is in the archive as it was first written, without the sizes
+		uint64_t name_end = saved.header_pos + sizeof(DirectoryHeader) + sizeof(NameType) * saved.header.name_size;
+		if ((i && saved.header_pos <= last_pos) || name_end > record.archive_size)
+			return false;
+		last_pos = saved.header_pos;
+
+		DirectoryHeader header{};
+		archive.seekg(frame.header_pos);
+		if (!archive.read((char*)&header, sizeof(DirectoryHeader)) || header.type != TYPE_DIRECTORY ||
+			header.name_size || header.data_size)
+			return false;
+
+		frames.push_back(move(frame));
+	}
+
+	num_of_entries = (size_t)record.num_of_entries;
+	archive_size = record.archive_size;
+	return true;
+}
+
+size_t Checkpoint::Restore(vector<DirectoryFrame>& frames)
+{
+	frames = move(this->frames);
+	this->frames.clear();
+	return num_of_entries;
+}
+
+void Checkpoint::Update(ostream& os, const vector<DirectoryFrame>& frames, size_t num_of_entries)
+{
+	// the complete archive needs no journal
+	if (num_of_entries == manifest_size)
+		return;
+
+	auto now = chrono::steady_clock::now();
+	if (now - last_save < interval)
+		return;
+
+	Save(os, frames, num_of_entries);
+	last_save = now;
+}
+
+void Checkpoint::Save(ostream& os, const vector<DirectoryFrame>& frames, size_t num_of_entries)
+{
+	if (!os.flush()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "Checkpoint::Save", archive_path, ec };
+	}
+	SyncFile(archive_path);
+
+	fs::path new_journal_path = journal_path;
+	new_journal_path += CHECKPOINT_NEW_SUFFIX;
+	{
+		ofstream journal{ new_journal_path, ios_base::binary };
+		if (!journal.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "Checkpoint::Save", new_journal_path, ec };
+		}
+
+		CheckpointRecord record{ job_hash, num_of_entries, (uint64_t)os.tellp(), (uint32_t)frames.size() };
+		journal.write((char*)&record, sizeof(CheckpointRecord));
+
+		for (const auto& frame : frames) {
+			CheckpointFrame saved{ (uint64_t)(streamoff)frame.header_pos, frame.header, frame.remaining, frame.solid_size,
+								   (uint32_t)frame.solid_files.size() };
+			journal.write((char*)&saved, sizeof(CheckpointFrame));
+
+			for (const auto& file_path : frame.solid_files) {
+				const auto& path = file_path.native();
+				uint32_t path_size = (uint32_t)path.size();
+				journal.write((char*)&path_size, sizeof(uint32_t));
+				journal.write((char*)path.data(), sizeof(NameType) * path.size());
+			}
+		}
+
+		if (!journal.flush()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "Checkpoint::Save", new_journal_path, ec };
+		}
+	}
+
+	// the old journal stays until the new one is complete
+	SyncFile(new_journal_path);
+	fs::rename(new_journal_path, journal_path);
+}
+
+void Checkpoint::Finish()
+{
+	error_code ec;
+	fs::remove(journal_path, ec);
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef HUF_CHECKPOINT_H
+#define HUF_CHECKPOINT_H
+
+#include <stdint.h>
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+// seconds between saves of the journal
+#define CHECKPOINT_INTERVAL 60
+
+namespace Huffman
+{
+
+// a directory of Compress whose header is not written yet
+struct DirectoryFrame
+{
+	std::streampos header_pos;
+	DirectoryHeader header;
+	size_t remaining; // children not written yet
+	std::vector<std::filesystem::path> solid_files;
+	uintmax_t solid_size;
+};
+
+#pragma pack(push, 1)
+
+// journal: CheckpointRecord, then CheckpointFrame * number of frames, each followed by its solid files
+// (uint32_t path size, path (NameType * path size))
+struct CheckpointRecord
+{
+	uint64_t job_hash; // of the manifest and the options, the journal is used only for the same job
+	uint64_t num_of_entries; // of the manifest written
+	uint64_t archive_size; // bytes of the archive written with them
+	uint32_t num_of_frames;
+};
+
+struct CheckpointFrame
+{
+	uint64_t header_pos;
+	DirectoryHeader header;
+	uint64_t remaining;
+	uint64_t solid_size;
+	uint32_t num_of_solid_files;
+};
+
+#pragma pack(pop)
+
+// Journal of Compress into an archive file, so an interrupted run goes on from the last save instead of starting over.
+// It is saved between entries, after the archive is flushed to the disk: the archive up to archive_size
+// and the directories still open are all that is needed to write the rest.
+// The manifest of the new run must be in the same order, so the journal is used only if nothing in it changed.
+class Checkpoint
+{
+public:
+	// interval: seconds between saves, 0 saves after every entry
+	Checkpoint(const std::filesystem::path& archive_path, const std::filesystem::path& journal_path,
+			   unsigned interval = CHECKPOINT_INTERVAL);
+
+	Checkpoint(const Checkpoint&) = delete;
+	Checkpoint& operator=(const Checkpoint&) = delete;
+
+	// Called before Compress. If the journal is of the same job and the archive holds what it saved,
+	// the archive is truncated to that point and true is returned: open it without truncating and write at its end.
+	// otherwise the job starts over
+	bool Load(const Manifest& manifest, const CompressOptions& options);
+
+	// called by Compress: the directories still open, return the index of the manifest to go on from
+	size_t Restore(std::vector<DirectoryFrame>& frames);
+
+	// called by Compress after each entry, saves the journal when the interval has passed
+	void Update(std::ostream& dst, const std::vector<DirectoryFrame>& frames, size_t num_of_entries);
+
+	// removes the journal once the archive is complete and flushed
+	void Finish();
+
+private:
+	bool LoadJournal(size_t manifest_size);
+	void Save(std::ostream& dst, const std::vector<DirectoryFrame>& frames, size_t num_of_entries);
+
+	std::filesystem::path archive_path;
+	std::filesystem::path journal_path;
+	std::chrono::seconds interval;
+	std::chrono::steady_clock::time_point last_save;
+	uint64_t job_hash = 0;
+	size_t manifest_size = 0;
+
+	// loaded from the journal
+	size_t num_of_entries = 0;
+	uint64_t archive_size = 0;
+	std::vector<DirectoryFrame> frames;
+};
+
+}
+
+#endif // HUF_CHECKPOINT_H
@@ -0,0 +1,384 @@
+#include "huf_lz77.hpp"
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#define LZ77_HASH_BITS 16
+#define LZ77_DIRECT_MAX 16 // values below this are tokens without extra bits
+
+using namespace std;
+
+namespace Huffman
+{
+
+struct Lz77Level
+{
+	unsigned max_chain; // candidates tried per position
+	size_t nice_length; // a match this long is taken without trying more
+	bool lazy; // a match is dropped if the next position has a longer one
+};
+
+static const Lz77Level lz77_levels[LZ77_LEVEL_MAX + 1] = {
+	{ 0, 0, false },
+	{ 4, 16, false },
+	{ 8, 24, false },
+	{ 16, 32, false },
+	{ 32, 64, true },
+	{ 64, 128, true },
+	{ 128, 258, true },
+	{ 256, 512, true },
+	{ 1024, 1024, true },
+	{ 4096, 4096, true },
+};
+
+class BitWriter
+{
+public:
+	void Write(uint32_t value, int size)
+	{
+		bits |= (uint64_t)value << num_of_bits;
+		num_of_bits += size;
+		while (num_of_bits >= BYTE_BITS) {
+			out.push_back((char)bits);
+			bits >>= BYTE_BITS;
+			num_of_bits -= BYTE_BITS;
+		}
+	}
+
+	// the last byte is padded with zero
+	const string& Finish()
+	{
+		if (num_of_bits)
+			out.push_back((char)bits);
+		bits = num_of_bits = 0;
+		return out;
+	}
+
+private:
+	string out;
+	uint64_t bits = 0;
+	int num_of_bits = 0;
+};
+
+class BitReader
+{
+public:
+	explicit BitReader(const string& in)
+		: in{ in } {}
+
+	uint32_t Read(int size)
+	{
+		while (num_of_bits < size) {
+			if (pos == in.size())
+				throw runtime_error{ "Invalid file: LZ77 extra bits are truncated" };
+			bits |= (uint64_t)(unsigned char)in[pos++] << num_of_bits;
+			num_of_bits += BYTE_BITS;
+		}
+		uint32_t value = (uint32_t)(bits & ((1ull << size) - 1));
+		bits >>= size;
+		num_of_bits -= size;
+		return value;
+	}
+
+private:
+	const string& in;
+	size_t pos = 0;
+	uint64_t bits = 0;
+	int num_of_bits = 0;
+};
+
+static void PutValue(uint32_t value, string& tokens, BitWriter& extra)
+{
+	if (value < LZ77_DIRECT_MAX) {
+		tokens.push_back((char)value);
+		return;
+	}
+
+	int top = 0; // position of the highest bit, at least 4
+	while (value >> (top + 1))
+		top++;
+
+	tokens.push_back((char)(LZ77_DIRECT_MAX + (top - 4) * 2 + ((value >> (top - 1)) & 1)));
+	extra.Write(value & ((1u << (top - 1)) - 1), top - 1);
+}
+
+static uint32_t GetValue(unsigned char token, BitReader& extra)
+{
+	if (token < LZ77_DIRECT_MAX)
+		return token;
+
+	int top = (token - LZ77_DIRECT_MAX) / 2 + 4;
+	if (top > 31)
+		throw out_of_range{ "Invalid file: Invalid LZ77 token: " + to_string(token) };
+
+	uint32_t value = (2u | (token & 1)) << (top - 1);
+	return value | extra.Read(top - 1);
+}
+
+static void EncodeTokens(const string& tokens, ostream& os, Encoder& encoder)
+{
+	istringstream tokens_is{ tokens };
+	ostringstream data_os;
+	encoder.Encoding(tokens_is, data_os);
+	os << data_os.str();
+}
+
+static string DecodeTokens(istream& is, Decoder& decoder)
+{
+	ostringstream tokens_os;
+	decoder.Decode(is, tokens_os, ReadHufHeader(is));
+	return tokens_os.str();
+}
+
+static const Lz77Level& GetLz77Level(int level)
+{
+	if (level < 1 || level > LZ77_LEVEL_MAX)
+		throw out_of_range{ "Invalid LZ77 level: " + to_string(level) };
+	return lz77_levels[level];
+}
+
+Lz77Encoder::Lz77Encoder(int level)
+	: params{ GetLz77Level(level) }, head(1 << LZ77_HASH_BITS, -1), prev(LZ77_WINDOW_SIZE) {}
+
+void Lz77Encoder::EncodeBlock(ostream& os, const char* data, size_t size)
+{
+	size_t block_pos = buffer.size();
+	buffer.append(data, size);
+
+	string literals, lengths, distances;
+	BitWriter extra;
+	uint32_t num_of_sequences = 0;
+
+	size_t literal_pos = block_pos;
+	for (size_t pos = block_pos; pos < buffer.size();) {
+		uint32_t distance = 0;
+		size_t length = FindMatch(pos, distance);
+		Insert(pos);
+
+		if (length >= LZ77_MIN_MATCH && params.lazy) {
+			uint32_t next_distance = 0;
+			size_t next_length = FindMatch(pos + 1, next_distance);
+			if (next_length > length) {
+				pos++;
+				Insert(pos);
+				length = next_length;
+				distance = next_distance;
+			}
+		}
+
+		if (length < LZ77_MIN_MATCH) {
+			pos++;
+			continue;
+		}
+
+		literals.append(buffer, literal_pos, pos - literal_pos);
+		PutValue((uint32_t)(pos - literal_pos), lengths, extra);
+		PutValue((uint32_t)(length - LZ77_MIN_MATCH + 1), lengths, extra);
+		PutValue(distance - 1, distances, extra);
+		num_of_sequences++;
+
+		for (size_t i = pos + 1; i < pos + length; i++)
+			Insert(i);
+		pos += length;
+		literal_pos = pos;
+	}
+
+	// the rest of the block, without a match
+	literals.append(buffer, literal_pos, string::npos);
+	PutValue((uint32_t)(buffer.size() - literal_pos), lengths, extra);
+	PutValue(0, lengths, extra);
+	num_of_sequences++;
+
+	const string& extra_bits = extra.Finish();
+	Lz77Block block{ (uint32_t)size, num_of_sequences, (uint32_t)extra_bits.size() };
+	os.write((char*)&block, sizeof(Lz77Block));
+	EncodeTokens(literals, os, encoder);
+	EncodeTokens(lengths, os, encoder);
+	EncodeTokens(distances, os, encoder);
+	os.write(extra_bits.data(), extra_bits.size());
+
+	// only the window is kept for the next block
+	if (buffer.size() > LZ77_WINDOW_SIZE) {
+		size_t erase_size = buffer.size() - LZ77_WINDOW_SIZE;
+		buffer.erase(0, erase_size);
+		base += erase_size;
+	}
+}
+
+uint32_t Lz77Encoder::Hash(size_t pos) const
+{
+	const unsigned char* p = (const unsigned char*)buffer.data() + pos;
+	uint32_t value = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+	return (value * 2654435761u) >> (32 - LZ77_HASH_BITS);
+}
+
+void Lz77Encoder::Insert(size_t pos)
+{
+	if (pos + LZ77_MIN_MATCH > buffer.size())
+		return;
+	uint32_t hash = Hash(pos);
+	int64_t abs_pos = base + pos;
+	prev[abs_pos % LZ77_WINDOW_SIZE] = head[hash];
+	head[hash] = abs_pos;
+}
+
+// return the length of the longest match found, 0 if there is none
+size_t Lz77Encoder::FindMatch(size_t pos, uint32_t& distance) const
+{
+	if (pos + LZ77_MIN_MATCH > buffer.size())
+		return 0;
+
+	const char* data = buffer.data();
+	size_t max_length = buffer.size() - pos;
+	int64_t abs_pos = base + pos;
+	size_t best_length = 0;
+	unsigned chain = params.max_chain;
+
+	for (int64_t candidate = head[Hash(pos)];
+			candidate >= 0 && abs_pos - candidate < LZ77_WINDOW_SIZE && chain--;
+			candidate = prev[candidate % LZ77_WINDOW_SIZE]) {
+		size_t match_pos = candidate - base;
+		if (data[match_pos + best_length] != data[pos + best_length])
+			continue;
+
+		size_t length = 0;
+		while (length < max_length && data[match_pos + length] == data[pos + length])
+			length++;
+
+		if (length > best_length) {
+			best_length = length;
+			distance = (uint32_t)(abs_pos - candidate);
+			if (length >= params.nice_length || length == max_length)
+				break;
+		}
+	}
+	return best_length;
+}
+
+void EncodeLz77(istream& is, ostream& os, int level)
+{
+	Lz77Encoder encoder{ level };
+
+	HufHeader header{};
+	header.lz77 = 1;
+	os.write((char*)&header, sizeof(HufHeader));
+
+	vector<char> in_buffer(LZ77_BLOCK_SIZE);
+
+	while (is.read(in_buffer.data(), in_buffer.size()) || is.gcount())
+		encoder.EncodeBlock(os, in_buffer.data(), is.gcount());
+
+	Lz77Block last_block{};
+	os.write((char*)&last_block, sizeof(Lz77Block));
+}
+
+bool ReadLz77Block(istream& is, Lz77Block& block)
+{
+	if (!is.read((char*)&block, sizeof(Lz77Block)))
+		throw runtime_error{ "Invalid file: LZ77 block is truncated" };
+
+	if (block.byte_count > LZ77_BLOCK_SIZE)
+		throw out_of_range{ "Invalid file: Invalid LZ77 block size: " + to_string(block.byte_count) };
+
+	return block.byte_count;
+}
+
+string_view Lz77Decoder::DecodeBlock(istream& is, const Lz77Block& block)
+{
+	// only the window is kept from the blocks before
+	if (buffer.size() > LZ77_WINDOW_SIZE)
+		buffer.erase(0, buffer.size() - LZ77_WINDOW_SIZE);
+
+	string literals = DecodeTokens(is, decoder);
+	string lengths = DecodeTokens(is, decoder);
+	string distances = DecodeTokens(is, decoder);
+
+	string extra_bits(block.extra_size, 0);
+	if (!is.read(extra_bits.data(), extra_bits.size()))
+		throw runtime_error{ "Invalid file: LZ77 extra bits are truncated" };
+
+	BitReader extra{ extra_bits };
+	size_t block_end = buffer.size() + block.byte_count;
+	size_t literal_pos = 0, length_pos = 0, distance_pos = 0;
+	buffer.reserve(block_end);
+
+	auto invalid_block = []() {
+		return runtime_error{ "Invalid file: Invalid LZ77 block" };
+	};
+
+	for (uint32_t i = 0; i < block.num_of_sequences; i++) {
+		if (length_pos + 2 > lengths.size())
+			throw invalid_block();
+
+		size_t literal_run = GetValue(lengths[length_pos++], extra);
+		size_t match_length = GetValue(lengths[length_pos++], extra);
+		if (literal_run > literals.size() - literal_pos || literal_run > block_end - buffer.size())
+			throw invalid_block();
+
+		buffer.append(literals, literal_pos, literal_run);
+		literal_pos += literal_run;
+		if (!match_length)
+			continue;
+
+		match_length += LZ77_MIN_MATCH - 1;
+		if (distance_pos == distances.size())
+			throw invalid_block();
+		size_t distance = (size_t)GetValue(distances[distance_pos++], extra) + 1;
+		if (distance > buffer.size() || distance > LZ77_WINDOW_SIZE || match_length > block_end - buffer.size())
+			throw invalid_block();
+
+		// the match may overlap what it writes
+		size_t match_pos = buffer.size() - distance;
+		size_t out_pos = buffer.size();
+		buffer.resize(out_pos + match_length);
+		for (size_t n = 0; n < match_length; n++)
+			buffer[out_pos + n] = buffer[match_pos + n];
+	}
+
+	if (buffer.size() != block_end)
+		throw invalid_block();
+
+	return string_view{ buffer }.substr(block_end - block.byte_count);
+}
+
+void DecodeLz77(istream& is, ostream& os, size_t first, size_t count)
+{
+	uint64_t last = first + min(count, numeric_limits<size_t>::max() - first);
+	uint64_t offset = 0; // of the block in the decoded data
+	Lz77Decoder decoder;
+	Lz77Block block;
+
+	for (; ReadLz77Block(is, block); offset += block.byte_count) {
+		// nothing after the range is needed
+		if (offset >= last) {
+			for (int i = 0; i < 3; i++)
+				SkipEncodedData(is);
+			is.seekg(block.extra_size, ios_base::cur);
+			continue;
+		}
+
+		string_view data = decoder.DecodeBlock(is, block);
+
+		uint64_t begin = max<uint64_t>(first, offset);
+		uint64_t end = min<uint64_t>(last, offset + block.byte_count);
+		if (begin < end)
+			os.write(data.data() + (begin - offset), end - begin);
+	}
+}
+
+uint64_t SkipLz77Data(istream& is)
+{
+	uint64_t size = 0;
+	Lz77Block block;
+	while (ReadLz77Block(is, block)) {
+		for (int i = 0; i < 3; i++)
+			SkipEncodedData(is);
+		is.seekg(block.extra_size, ios_base::cur);
+		size += block.byte_count;
+	}
+	return size;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef HUF_LZ77_H
+#define HUF_LZ77_H
+
+#include <stdint.h>
+#include <istream>
+#include <ostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "huffman.hpp"
+
+#define LZ77_LEVEL_MAX 9
+#define LZ77_LEVEL_DEFAULT 5
+
+#define LZ77_WINDOW_SIZE 0x40000 // 256KiB, farthest distance of a match
+#define LZ77_BLOCK_SIZE 0x100000 // 1MiB of the source per block
+#define LZ77_MIN_MATCH 4
+
+namespace Huffman
+{
+
+#pragma pack(push, 1)
+
+// LZ77 data: HufHeader (only lz77 is used), blocks, and a block with byte_count 0
+// block: Lz77Block, literals, lengths, distances (each written by Encoding), extra bits
+struct Lz77Block
+{
+	uint32_t byte_count; // source bytes
+	uint32_t num_of_sequences;
+	uint32_t extra_size; // bytes of the extra bits
+};
+
+#pragma pack(pop)
+
+// A sequence is a run of literals followed by a match, whose length is 0 for the last sequence of a block.
+// The literals, the lengths (literal runs and matches) and the distances are coded with their own Huffman tables.
+// Values of 16 or more are stored as a token of their bucket and the bits below the top two as extra bits.
+// level: 1 (fastest) ~ LZ77_LEVEL_MAX (smallest), src is read once
+void EncodeLz77(std::istream& src, std::ostream& dst, int level = LZ77_LEVEL_DEFAULT);
+
+// src: right after the HufHeader, left at the end of the data
+// writes bytes [first, first + count), the blocks before them are decoded too for the matches
+void DecodeLz77(std::istream& src, std::ostream& dst, size_t first = 0, size_t count = std::numeric_limits<size_t>::max());
+
+// skips the blocks and returns their size after decoding
+uint64_t SkipLz77Data(std::istream& src);
+
+// return false for the last block
+bool ReadLz77Block(std::istream& src, Lz77Block& block);
+
+struct Lz77Level;
+
+// Hash chains over the window and the block being encoded, kept from one block to the next.
+// EncodeLz77 gives it LZ77_BLOCK_SIZE bytes at a time, a caller getting the source in pieces can give less.
+class Lz77Encoder
+{
+public:
+	// level: 1 ~ LZ77_LEVEL_MAX
+	explicit Lz77Encoder(int level);
+
+	// writes the Lz77Block and the streams of at most LZ77_BLOCK_SIZE bytes of the source
+	void EncodeBlock(std::ostream& dst, const char* data, size_t size);
+
+private:
+	uint32_t Hash(size_t pos) const;
+	void Insert(size_t pos);
+	size_t FindMatch(size_t pos, uint32_t& distance) const;
+
+	const Lz77Level& params;
+	std::string buffer; // the window and the block, buffer[0] is at base in the source
+	int64_t base = 0;
+	std::vector<int64_t> head; // last position of each hash
+	std::vector<int64_t> prev; // previous position of the same hash, by position % LZ77_WINDOW_SIZE
+	Encoder encoder; // of the three streams of every block
+};
+
+// The window of the blocks decoded so far, for the matches of the next one
+class Lz77Decoder
+{
+public:
+	// src: right after the Lz77Block. return the bytes of the block, valid until the next call
+	std::string_view DecodeBlock(std::istream& src, const Lz77Block& block);
+
+private:
+	std::string buffer; // the window and the block
+	Decoder decoder; // of the three streams of every block
+};
+
+}
+
+#endif // HUF_LZ77_H
@@ -0,0 +1,319 @@
+#include "huf_search.hpp"
+#include "huf_sparse.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+// offset of a match in the decoded data
+using MatchFound = function<void(uint64_t)>;
+
+// Finds the pattern in the bytes written to it, keeping only the bytes a match may still start in
+class MatchWriter : public streambuf
+{
+public:
+	// first: offset of the first byte written, matches starting at limit or after it are not reported
+	MatchWriter(const string& pattern, uint64_t first, uint64_t limit, const MatchFound& found)
+		: pattern{ pattern }, buffer_pos{ first }, limit{ limit }, found{ found } {}
+
+protected:
+	streamsize xsputn(const char* data, streamsize size) override
+	{
+		buffer.append(data, (size_t)size);
+
+		string_view view{ buffer };
+		for (size_t pos = view.find(pattern); pos != string_view::npos && buffer_pos + pos < limit; pos = view.find(pattern, pos + 1))
+			found(buffer_pos + pos);
+
+		// a match starting in the kept bytes ends in the next write, so none is reported twice
+		size_t keep = min(buffer.size(), pattern.size() - 1);
+		buffer_pos += buffer.size() - keep;
+		buffer.erase(0, buffer.size() - keep);
+		return size;
+	}
+
+	int_type overflow(int_type c) override
+	{
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			char ch = traits_type::to_char_type(c);
+			xsputn(&ch, 1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+private:
+	const string& pattern;
+	string buffer;
+	uint64_t buffer_pos; // of buffer[0] in the decoded data
+	uint64_t limit;
+	const MatchFound& found;
+};
+
+// a part of the decoded data that is one file, or one extent of a sparse file
+struct SearchPart
+{
+	uint64_t data_offset;
+	uint64_t size;
+	uint64_t file_offset;
+	const fs::path* path;
+};
+
+// the codes of the pattern starting at one bit of a byte: bytes[0] and bytes.back() have only the bits of mask
+struct ShiftedCodes
+{
+	string bytes;
+	string mask;
+	string_view core; // bytes between the first and the last one, all bits used
+};
+
+class Searcher
+{
+public:
+	Searcher(const string& pattern, const function<void(const SearchMatch&)>& found, uint32_t archive_version)
+		: pattern{ pattern }, found{ found }, archive_version{ archive_version } {}
+
+	// src: at the header of the entry, left at the end of it
+	void SearchEntry(istream& is, const fs::path& parent);
+
+private:
+	void SearchParts(istream& is, const vector<SearchPart>& parts);
+	void SearchData(istream& is, const MatchFound& found);
+	bool FindCodes(istream& is, const HufHeader& header, vector<size_t>& intervals);
+
+	const string& pattern;
+	const function<void(const SearchMatch&)>& found;
+	uint32_t archive_version;
+	Decoder decoder;
+};
+
+void Searcher::SearchEntry(istream& is, const fs::path& parent)
+{
+	Header header{};
+	ReadEntryHeader(is, archive_version, header);
+
+	fs::path::string_type name(header.name_size, 0);
+	is.read((char*)name.data(), sizeof(NameType) * header.name_size);
+	fs::path path = parent / name;
+
+	switch (header.type) {
+	case TYPE_REGULAR_FILE: {
+		vector<SearchPart> parts;
+		if (header.data_size) {
+			vector<SparseExtent> extents;
+			ReadSparseExtents(is, header.data_size, extents);
+
+			uint64_t data_offset = 0;
+			for (const auto& extent : extents) {
+				parts.push_back({ data_offset, extent.size, extent.offset, &path });
+				data_offset += extent.size;
+			}
+		}
+		else {
+			parts.push_back({ 0, numeric_limits<uint64_t>::max(), 0, &path });
+		}
+		SearchParts(is, parts);
+		break;
+	}
+	case TYPE_DIRECTORY:
+		for (size_t i = 0; i < header.data_size; i++)
+			SearchEntry(is, path);
+		break;
+	case TYPE_SOLID_BLOCK: {
+		vector<fs::path> paths;
+		vector<SearchPart> parts;
+		uint64_t data_offset = 0;
+
+		for (size_t i = 0; i < header.data_size; i++) {
+			SolidEntry entry{};
+			if (!is.read((char*)&entry, sizeof(SolidEntry)) || entry.name_size >= FILENAME_MAX || !entry.name_size)
+				throw out_of_range{ "Invalid file header: Invalid solid entry" };
+
+			fs::path::string_type file_name(entry.name_size, 0);
+			is.read((char*)file_name.data(), sizeof(NameType) * entry.name_size);
+			paths.push_back(parent / file_name);
+			parts.push_back({ data_offset, entry.data_size, 0, nullptr });
+			data_offset += entry.data_size;
+		}
+		for (size_t i = 0; i < parts.size(); i++)
+			parts[i].path = &paths[i];
+
+		SearchParts(is, parts);
+		break;
+	}
+	}
+}
+
+// the matches come in order, so the part of each one is found from the part of the last one
+void Searcher::SearchParts(istream& is, const vector<SearchPart>& parts)
+{
+	size_t index = 0;
+
+	SearchData(is, [&](uint64_t offset) {
+		while (index < parts.size() && offset - parts[index].data_offset >= parts[index].size)
+			index++;
+		if (index == parts.size())
+			return;
+
+		// a match crossing the end of a file or an extent is not in one file
+		const SearchPart& part = parts[index];
+		if (pattern.size() <= part.size - (offset - part.data_offset))
+			found({ *part.path, part.file_offset + (offset - part.data_offset) });
+	});
+}
+
+// src: at the HufHeader (LegacyHufHeader in the old layout), left at the end of the data
+void Searcher::SearchData(istream& is, const MatchFound& found)
+{
+	// the old layout has no sync points to skip to
+	if (archive_version == ARCHIVE_VERSION_LEGACY) {
+		MatchWriter writer{ pattern, 0, numeric_limits<uint64_t>::max(), found };
+		ostream os{ &writer };
+		decoder.DecodeLegacy(is, os);
+		return;
+	}
+
+	auto header_pos = is.tellg();
+	HufHeader header = ReadHufHeader(is);
+	auto data_pos = header_pos + (streamoff)sizeof(HufHeader);
+
+	vector<size_t> intervals;
+	if (!FindCodes(is, header, intervals)) {
+		is.seekg(data_pos);
+		MatchWriter writer{ pattern, 0, numeric_limits<uint64_t>::max(), found };
+		ostream os{ &writer };
+		decoder.Decode(is, os, header);
+		return;
+	}
+
+	// each interval with the codes is decoded with the start of the next one, for a match ending there
+	uint64_t interval_size = header.sync_interval ? header.sync_interval : GetDecodedSize(header);
+	for (size_t interval : intervals) {
+		uint64_t first = interval * interval_size;
+		is.seekg(data_pos);
+		MatchWriter writer{ pattern, first, first + interval_size, found };
+		ostream os{ &writer };
+		decoder.DecodeRange(is, os, header, (size_t)first, (size_t)(interval_size + pattern.size() - 1));
+	}
+	is.seekg(data_pos + (streamoff)GetEncodedSize(header));
+}
+
+// Searches static data of 8 bit tokens for the codes of the pattern, at every bit offset.
+// A match starts a token, so its codes are in the data, but the codes can also be found across tokens:
+// intervals gets the sync intervals (index of the sync point before them) where they are, to be decoded.
+// return false if the data is not static data of 8 bit tokens or the codes are too short to skip much of it
+// src: right after the HufHeader, left at the end of the data if true is returned
+bool Searcher::FindCodes(istream& is, const HufHeader& header, vector<size_t>& intervals)
+{
+	// a tree of one token has no code
+	if (header.token_mode != TOKEN_MODE_8 || header.adaptive || header.lz77 || header.ans || header.records_size < 2)
+		return false;
+
+	vector<Codec8::Record> records(header.records_size);
+	if (!is.read((char*)records.data(), sizeof(Codec8::Record) * records.size()))
+		throw runtime_error{ "Invalid file header: token records are truncated" };
+
+	auto destroy = [](Codec8::Node* tree) { DestroyPODNodes(tree); };
+	unique_ptr<Codec8::Node, decltype(destroy)> tree{ DecodeTokenRecords<Codec8>(records.data(), header.records_size), destroy };
+	if (!tree)
+		throw runtime_error{ "Invalid file header: Invalid token records" };
+	vector<Code> codes = MakeCodeTable<Codec8>(tree.get());
+
+	vector<bool> bits;
+	for (unsigned char c : pattern) {
+		const Code& code = codes[c];
+		if (code.size > MAX_CODE_LENGTH)
+			return false;
+		// a token that is not in the data
+		if (!code.size) {
+			is.seekg(sizeof(uint64_t) * GetNumOfSyncPoints(header) + header.data_size, ios_base::cur);
+			return true;
+		}
+		for (uint32_t i = 0; i < code.size; i++)
+			bits.push_back(code.code >> i & 1);
+	}
+	if (bits.size() < SEARCH_MIN_CODE_BITS)
+		return false;
+
+	vector<uint64_t> sync_points(GetNumOfSyncPoints(header));
+	if (!is.read((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size()))
+		throw runtime_error{ "Invalid file header: sync points are truncated" };
+
+	ShiftedCodes shifted[BYTE_BITS];
+	size_t max_size = 0;
+	for (size_t a = 0; a < BYTE_BITS; a++) {
+		auto& s = shifted[a];
+		s.bytes.assign((a + bits.size() + BYTE_BITS - 1) / BYTE_BITS, 0);
+		s.mask.assign(s.bytes.size(), 0);
+		for (size_t k = 0; k < bits.size(); k++) {
+			s.bytes[(a + k) / BYTE_BITS] |= (char)(bits[k] << (a + k) % BYTE_BITS);
+			s.mask[(a + k) / BYTE_BITS] |= (char)(1 << (a + k) % BYTE_BITS);
+		}
+		s.core = string_view{ s.bytes }.substr(1, s.bytes.size() - 2);
+		max_size = max(max_size, s.bytes.size());
+	}
+
+	string piece;
+	uint64_t piece_pos = 0; // of piece[0] in the data
+	uint64_t data_left = header.data_size;
+
+	while (data_left) {
+		// the bytes of codes that may go on into the next piece are kept
+		size_t keep = min(piece.size(), max_size - 1);
+		piece_pos += piece.size() - keep;
+		piece.erase(0, piece.size() - keep);
+
+		size_t size = (size_t)min<uint64_t>(data_left, SEARCH_PIECE_SIZE);
+		piece.resize(keep + size);
+		if (!is.read(&piece[keep], size))
+			throw runtime_error{ "Invalid file: compressed data is truncated" };
+		data_left -= size;
+
+		string_view view{ piece };
+		for (size_t a = 0; a < BYTE_BITS; a++) {
+			const auto& s = shifted[a];
+			size_t last = s.bytes.size() - 1;
+
+			// the core is found first, then the bits of the first and the last byte are compared
+			for (size_t pos = view.find(s.core, 1); pos != string_view::npos; pos = view.find(s.core, pos + 1)) {
+				size_t first = pos - 1;
+				if (first + s.bytes.size() > piece.size())
+					break;
+				if ((piece[first] & s.mask[0]) != s.bytes[0] || (piece[first + last] & s.mask[last]) != s.bytes[last])
+					continue;
+
+				uint64_t bit = (piece_pos + first) * BYTE_BITS + a;
+				size_t interval = upper_bound(sync_points.begin(), sync_points.end(), bit) - sync_points.begin();
+				intervals.push_back(interval);
+
+				// the rest of the interval is decoded anyway
+				if (interval == sync_points.size() || sync_points[interval] / BYTE_BITS >= piece_pos + piece.size())
+					break;
+				pos = max<size_t>(pos, (size_t)(sync_points[interval] / BYTE_BITS - piece_pos));
+			}
+		}
+	}
+
+	sort(intervals.begin(), intervals.end());
+	intervals.erase(unique(intervals.begin(), intervals.end()), intervals.end());
+	return true;
+}
+
+void Search(istream& is, const string& pattern, const function<void(const SearchMatch&)>& found)
+{
+	if (pattern.empty())
+		throw invalid_argument{ "The search pattern is empty" };
+
+	uint32_t archive_version = ReadArchiveHeader(is);
+	Searcher{ pattern, found, archive_version }.SearchEntry(is, {});
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef HUF_SEARCH_H
+#define HUF_SEARCH_H
+
+#include <stdint.h>
+#include <string>
+#include <istream>
+#include <functional>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+// the codes of a shorter pattern appear too often in the data to skip much of it, the data is decoded instead
+#define SEARCH_MIN_CODE_BITS 32
+// the data is searched for the codes SEARCH_PIECE_SIZE bytes at a time
+#define SEARCH_PIECE_SIZE 0x100000 // 1MiB
+
+namespace Huffman
+{
+
+struct SearchMatch
+{
+	std::filesystem::path path; // of the file in the archive, starting with the name of the first entry
+	uint64_t offset; // in the file
+};
+
+// Finds pattern in the files of the archive without writing them anywhere. found is called for each match, in order.
+// Static data of 8 bit tokens is first searched for the codes of the pattern at every bit, and only the sync
+// intervals where they appear are decoded to find the matches, since the codes can also appear across tokens.
+// A file without a token of the pattern is skipped. The other data is decoded into memory as it is searched.
+// Matches in a sparse file are found in its data, a match crossing a hole is not.
+// src: at the ArchiveHeader, must be seekable
+void Search(std::istream& src, const std::string& pattern, const std::function<void(const SearchMatch&)>& found);
+
+}
+
+#endif // HUF_SEARCH_H
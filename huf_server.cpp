@@ -0,0 +1,378 @@
+#include "huf_server.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cerrno>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+#if defined(__unix__) || defined(__APPLE__)
+
+struct ServerJob
+{
+	int fd;
+	string options;
+	fs::path src;
+	fs::path dst;
+	chrono::steady_clock::time_point accepted;
+};
+
+// a connection whose request line has not come in full yet
+struct PendingRequest
+{
+	int fd;
+	string line;
+	chrono::steady_clock::time_point accepted;
+};
+
+struct ServerState
+{
+	mutex state_mutex;
+	condition_variable not_empty;
+	deque<ServerJob> queue;
+	bool stopping = false; // the workers finish the queued jobs and return
+
+	size_t running = 0;
+	size_t completed = 0;
+	size_t failed = 0;
+	chrono::microseconds total_latency{ 0 };
+	chrono::microseconds max_latency{ 0 };
+};
+
+static sockaddr_un MakeAddress(const fs::path& socket_path)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+
+	const string& path = socket_path.native();
+	if (path.size() >= sizeof(addr.sun_path))
+		throw out_of_range{ "Invalid socket path length: " + to_string(path.size()) };
+
+	path.copy(addr.sun_path, path.size());
+	return addr;
+}
+
+static void ThrowErrno(const char* what, const fs::path& path)
+{
+	throw fs::filesystem_error{ what, path, error_code{ errno, system_category() } };
+}
+
+static bool ReadLine(int fd, string& line)
+{
+	char buffer[0x400];
+	line.clear();
+
+	while (line.find('\n') == string::npos) {
+		ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+		if (len <= 0)
+			return false;
+		line.append(buffer, len);
+	}
+	line.erase(line.find('\n'));
+	return true;
+}
+
+static void WriteAll(int fd, const string& str)
+{
+	for (size_t pos = 0; pos < str.size();) {
+		ssize_t len = send(fd, str.data() + pos, str.size() - pos, MSG_NOSIGNAL);
+		if (len <= 0)
+			return; // the client is gone
+		pos += len;
+	}
+}
+
+static vector<string> Split(const string& line, char delim)
+{
+	vector<string> fields;
+	size_t first = 0, last;
+	while ((last = line.find(delim, first)) != string::npos) {
+		fields.push_back(line.substr(first, last - first));
+		first = last + 1;
+	}
+	fields.push_back(line.substr(first));
+	return fields;
+}
+
+// each worker keeps its encoder and decoder for all its jobs
+static fs::path Execute(const ServerJob& job, Encoder& encoder, Decoder& decoder)
+{
+	if (job.options.find('e') != string::npos) {
+		ofstream os{ job.dst, ios_base::binary };
+		if (!os.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "RunServer", job.dst, ec };
+		}
+
+		CompressOptions options;
+		options.solid = job.options.find('b') != string::npos;
+		options.token_mode = job.options.find('w') != string::npos ? TOKEN_MODE_16 : TOKEN_MODE_8;
+		options.adaptive = job.options.find('a') != string::npos;
+		if (size_t z = job.options.find('z'); z != string::npos)
+			options.lz77_level = atoi(job.options.c_str() + z + 1);
+		options.encoder = &encoder;
+		Compress(job.src, os, options);
+		return job.dst;
+	}
+	else if (job.options.find('d') != string::npos) {
+		ifstream is{ job.src, ios_base::binary };
+		if (!is.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "RunServer", job.src, ec };
+		}
+		return job.dst / decoder.Decompress(is, job.dst);
+	}
+	throw invalid_argument{ "Invalid request: " + job.options };
+}
+
+static string GetStatistics(ServerState& state)
+{
+	lock_guard<mutex> lock{ state.state_mutex };
+
+	size_t finished = state.completed + state.failed;
+	double avg_ms = finished ? state.total_latency.count() / 1000.0 / finished : 0;
+
+	char buffer[0x100];
+	snprintf(buffer, sizeof(buffer), "queue=%zu\trunning=%zu\tcompleted=%zu\tfailed=%zu\tavg_latency_ms=%.3f\tmax_latency_ms=%.3f",
+		state.queue.size(), state.running, state.completed, state.failed, avg_ms, state.max_latency.count() / 1000.0);
+	return buffer;
+}
+
+static void RunWorker(ServerState& state)
+{
+	Encoder encoder;
+	Decoder decoder;
+
+	while (true) {
+		unique_lock<mutex> lock{ state.state_mutex };
+		state.not_empty.wait(lock, [&]() { return !state.queue.empty() || state.stopping; });
+		if (state.queue.empty())
+			return;
+
+		ServerJob job = move(state.queue.front());
+		state.queue.pop_front();
+		state.running++;
+		lock.unlock();
+
+		string response;
+		bool good = true;
+		try {
+			response = "OK\t" + Execute(job, encoder, decoder).string() + "\n";
+		}
+		catch (exception& e) {
+			response = string{ "ERR\t" } + e.what() + "\n";
+			good = false;
+		}
+		WriteAll(job.fd, response);
+		close(job.fd);
+
+		auto latency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - job.accepted);
+
+		lock.lock();
+		state.running--;
+		(good ? state.completed : state.failed)++;
+		state.total_latency += latency;
+		state.max_latency = max(state.max_latency, latency);
+	}
+}
+
+// answers a statistics or invalid request at once, and queues the others for the workers.
+// never waits, since the caller also polls the other connections
+static void HandleRequest(ServerState& state, const PendingRequest& request)
+{
+	int fd = request.fd;
+	vector<string> fields;
+	size_t end = request.line.find('\n');
+	if (end != string::npos)
+		fields = Split(request.line.substr(0, end), '\t');
+
+	if (!fields.empty() && fields[0] == "q") {
+		WriteAll(fd, "OK\t" + GetStatistics(state) + "\n");
+		close(fd);
+		return;
+	}
+	if (fields.size() != 3) {
+		WriteAll(fd, "ERR\tInvalid request\n");
+		close(fd);
+		return;
+	}
+
+	ServerJob job{};
+	job.fd = fd;
+	job.options = fields[0];
+	job.src = fields[1];
+	job.dst = fields[2];
+	job.accepted = request.accepted;
+
+	unique_lock<mutex> lock{ state.state_mutex };
+	if (state.queue.size() >= SERVER_QUEUE_MAX) {
+		lock.unlock();
+		WriteAll(fd, "ERR\tBusy\n");
+		close(fd);
+		return;
+	}
+	state.queue.push_back(move(job));
+	state.not_empty.notify_one();
+}
+
+// the listening socket and the connections still sending their request are polled together,
+// so a slow or idle client never keeps the others waiting. returns only by throwing
+static void ServeConnections(ServerState& state, int server_fd, const fs::path& socket_path, vector<PendingRequest>& pending)
+{
+	const auto recv_timeout = chrono::seconds{ SERVER_RECV_TIMEOUT };
+	vector<pollfd> poll_fds;
+
+	while (true) {
+		poll_fds.clear();
+		poll_fds.push_back({ server_fd, (short)(pending.size() < SERVER_PENDING_MAX ? POLLIN : 0), 0 });
+		for (const auto& request : pending)
+			poll_fds.push_back({ request.fd, POLLIN, 0 });
+
+		// wake up when the oldest request times out
+		int timeout_ms = -1;
+		if (!pending.empty()) {
+			auto left = pending.front().accepted + recv_timeout - chrono::steady_clock::now();
+			timeout_ms = (int)max<chrono::milliseconds::rep>(chrono::ceil<chrono::milliseconds>(left).count(), 0);
+		}
+		if (poll(poll_fds.data(), poll_fds.size(), timeout_ms) < 0 && errno != EINTR)
+			ThrowErrno("RunServer", socket_path);
+
+		auto now = chrono::steady_clock::now();
+		for (size_t i = pending.size(); i-- > 0;) {
+			PendingRequest& request = pending[i];
+			bool closed = false;
+
+			if (poll_fds[i + 1].revents) {
+				char buffer[0x400];
+				ssize_t len = recv(request.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+				if (len > 0)
+					request.line.append(buffer, len);
+				else if (!len || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+					closed = true;
+			}
+
+			// a request cut short is answered as invalid
+			if (request.line.find('\n') != string::npos || closed || now - request.accepted >= recv_timeout) {
+				HandleRequest(state, request);
+				pending.erase(pending.begin() + i);
+			}
+		}
+
+		if (poll_fds[0].revents & POLLIN) {
+			int fd = accept(server_fd, nullptr, nullptr);
+			if (fd >= 0)
+				pending.push_back({ fd, {}, chrono::steady_clock::now() });
+		}
+	}
+}
+
+void RunServer(const fs::path& socket_path, unsigned num_of_workers)
+{
+	sockaddr_un addr = MakeAddress(socket_path);
+
+	int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server_fd < 0)
+		ThrowErrno("RunServer", socket_path);
+
+	if (fs::is_socket(socket_path))
+		unlink(addr.sun_path); // left by a previous server
+	if (bind(server_fd, (sockaddr*)&addr, sizeof(addr)) || listen(server_fd, SOMAXCONN)) {
+		close(server_fd);
+		ThrowErrno("RunServer", socket_path);
+	}
+
+	// the workers use state until they are joined, which is also done when ServeConnections throws
+	ServerState state;
+	vector<thread> workers;
+	vector<PendingRequest> pending;
+
+	try {
+		if (!num_of_workers)
+			num_of_workers = max(thread::hardware_concurrency(), 1u);
+		for (unsigned i = 0; i < num_of_workers; i++)
+			workers.emplace_back(RunWorker, ref(state));
+
+		ServeConnections(state, server_fd, socket_path, pending);
+	}
+	catch (...) {
+		{
+			lock_guard<mutex> lock{ state.state_mutex };
+			state.stopping = true;
+		}
+		state.not_empty.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+
+		for (const auto& request : pending)
+			close(request.fd);
+		close(server_fd);
+		throw;
+	}
+}
+
+string SendRequest(const fs::path& socket_path, const string& options, const fs::path& src, const fs::path& dst)
+{
+	sockaddr_un addr = MakeAddress(socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		ThrowErrno("SendRequest", socket_path);
+
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+		close(fd);
+		ThrowErrno("SendRequest", socket_path);
+	}
+
+	string request = options;
+	if (!src.empty() || !dst.empty())
+		request += "\t" + src.string() + "\t" + dst.string();
+	WriteAll(fd, request + "\n");
+
+	string response;
+	bool good = ReadLine(fd, response);
+	close(fd);
+
+	if (!good)
+		throw runtime_error{ "No response from the server" };
+	if (!response.compare(0, 3, "OK\t"))
+		return response.substr(3);
+	if (!response.compare(0, 4, "ERR\t"))
+		throw runtime_error{ response.substr(4) };
+	throw runtime_error{ "Invalid response from the server: " + response };
+}
+
+#else
+
+void RunServer(const fs::path& socket_path, unsigned num_of_workers)
+{
+	throw runtime_error{ "The server needs Unix domain sockets" };
+}
+
+string SendRequest(const fs::path& socket_path, const string& options, const fs::path& src, const fs::path& dst)
+{
+	throw runtime_error{ "The server needs Unix domain sockets" };
+}
+
+#endif
+
+}
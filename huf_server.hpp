@@ -0,0 +1,31 @@
+#ifndef HUF_SERVER_H
+#define HUF_SERVER_H
+
+#include <string>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+#define SERVER_QUEUE_MAX 256 // a request is answered "Busy" while this many requests are queued
+#define SERVER_RECV_TIMEOUT 5 // seconds to wait for a request line
+#define SERVER_PENDING_MAX 1024 // accepting waits while this many connections are sending their request
+
+namespace Huffman
+{
+
+// Serves requests on a Unix domain socket until the process is killed. One request per connection:
+//   request:  options '\t' source '\t' destination '\n'
+//     options: "e" (compress, 'b' added for solid blocks, 'w' for 16-bit tokens, 'a' for adaptive coding,
+//       'z' and a level for LZ77), "d" (decompress) or "q" (statistics, no paths)
+//     paths are used as they are, so they should be absolute
+//   response: "OK\t" result '\n' or "ERR\t" message '\n' ("ERR\tBusy" if the queue is full, the request can be sent again)
+//     result: path of the compressed file or of the decompressed entry, or the statistics
+void RunServer(const std::filesystem::path& socket_path, unsigned num_of_workers = 0);
+
+// sends one request to RunServer and returns the result. throws if the server answers an error
+std::string SendRequest(const std::filesystem::path& socket_path, const std::string& options,
+						const std::filesystem::path& src = {}, const std::filesystem::path& dst = {});
+
+}
+
+#endif // HUF_SERVER_H
@@ -0,0 +1,250 @@
+#include "huf_sparse.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define SPARSE_BUFFER_SIZE 0x10000
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+// the extents of the file system, or the whole file if it does not report them
+static vector<SparseExtent> SeekDataExtents(const fs::path& file_path, uint64_t file_size)
+{
+	vector<SparseExtent> extents;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	int fd = open(file_path.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		off_t pos = 0;
+		bool supported = true;
+
+		while ((uint64_t)pos < file_size) {
+			off_t data = lseek(fd, pos, SEEK_DATA);
+			if (data < 0) {
+				// ENXIO: holes to the end
+				supported = errno == ENXIO;
+				break;
+			}
+			off_t hole = lseek(fd, data, SEEK_HOLE);
+			if (hole < 0 || (uint64_t)hole > file_size)
+				hole = (off_t)file_size;
+			if (hole > data)
+				extents.push_back({ (uint64_t)data, (uint64_t)(hole - data) });
+			pos = hole;
+		}
+		close(fd);
+
+		if (supported)
+			return extents;
+		extents.clear();
+	}
+#endif
+	extents.push_back({ 0, file_size });
+	return extents;
+}
+
+vector<SparseExtent> FindDataExtents(const fs::path& file_path, uint64_t file_size)
+{
+	ifstream is{ file_path, ios_base::binary };
+	if (!is.good()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "FindDataExtents", file_path, ec };
+	}
+
+	vector<SparseExtent> extents;
+	vector<char> buffer(SPARSE_BLOCK_SIZE);
+
+	auto add_data = [&](uint64_t offset, uint64_t size) {
+		if (!extents.empty() && extents.back().offset + extents.back().size == offset)
+			extents.back().size += size;
+		else
+			extents.push_back({ offset, size });
+	};
+
+	// the aligned blocks of zeros in the data of the file system are holes too
+	for (const auto& extent : SeekDataExtents(file_path, file_size)) {
+		uint64_t pos = extent.offset;
+		uint64_t end = extent.offset + extent.size;
+		is.seekg(pos);
+
+		while (pos < end) {
+			uint64_t next_pos = min(end, (pos / SPARSE_BLOCK_SIZE + 1) * SPARSE_BLOCK_SIZE);
+			size_t size = (size_t)(next_pos - pos);
+			if (!is.read(buffer.data(), size)) {
+				auto ec = make_error_code(huf_errc::invalid_fstream);
+				throw fs::filesystem_error{ "FindDataExtents", file_path, ec };
+			}
+
+			bool is_zero = size == SPARSE_BLOCK_SIZE && !buffer[0] && !memcmp(buffer.data(), buffer.data() + 1, size - 1);
+			if (!is_zero)
+				add_data(pos, size);
+			pos = next_pos;
+		}
+	}
+
+	// adjacent data is merged, so a file without holes is one extent
+	if (extents.empty())
+		extents.push_back({ file_size, 0 });
+	else if (extents.size() == 1 && !extents[0].offset && extents[0].size == file_size)
+		extents.clear();
+	return extents;
+}
+
+uint64_t ReadSparseExtents(istream& is, size_t num_of_extents, vector<SparseExtent>& extents)
+{
+	uint64_t file_size = 0;
+	if (!is.read((char*)&file_size, sizeof(uint64_t)))
+		throw runtime_error{ "Invalid file header: sparse extents are truncated" };
+
+	uint64_t end = 0;
+	extents.clear();
+	for (size_t i = 0; i < num_of_extents; i++) {
+		SparseExtent extent{};
+		if (!is.read((char*)&extent, sizeof(SparseExtent)))
+			throw runtime_error{ "Invalid file header: sparse extents are truncated" };
+		if (extent.offset < end || extent.offset > file_size || extent.size > file_size - extent.offset)
+			throw out_of_range{ "Invalid file header: Invalid sparse extent" };
+
+		extents.push_back(extent);
+		end = extent.offset + extent.size;
+	}
+	return file_size;
+}
+
+void WriteSparseExtents(ostream& os, uint64_t file_size, const vector<SparseExtent>& extents)
+{
+	os.write((char*)&file_size, sizeof(uint64_t));
+	os.write((char*)extents.data(), sizeof(SparseExtent) * extents.size());
+}
+
+uint64_t GetExtentsSize(const vector<SparseExtent>& extents)
+{
+	uint64_t size = 0;
+	for (const auto& extent : extents)
+		size += extent.size;
+	return size;
+}
+
+ExtentReader::ExtentReader(istream& file, const vector<SparseExtent>& extents)
+	: file{ file }, extents{ extents }, total_size{ GetExtentsSize(extents) } {}
+
+ExtentReader::int_type ExtentReader::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	buffer_pos += egptr() - eback();
+	while (index < extents.size() && buffer_pos >= extent_pos + extents[index].size)
+		extent_pos += extents[index++].size;
+	if (index == extents.size())
+		return traits_type::eof();
+
+	// allocated on the first read, so an unused reader costs nothing
+	if (buffer.empty())
+		buffer.resize(SPARSE_BUFFER_SIZE);
+
+	uint64_t within = buffer_pos - extent_pos;
+	size_t size = (size_t)min<uint64_t>(buffer.size(), extents[index].size - within);
+	file.clear();
+	file.seekg(extents[index].offset + within);
+	file.read(buffer.data(), size);
+
+	setg(buffer.data(), buffer.data(), buffer.data() + file.gcount());
+	if (!file.gcount())
+		return traits_type::eof();
+	return traits_type::to_int_type(*gptr());
+}
+
+streamsize ExtentReader::showmanyc()
+{
+	uint64_t pos = buffer_pos + (gptr() - eback());
+	return pos < total_size ? (streamsize)(total_size - pos) : -1;
+}
+
+ExtentReader::pos_type ExtentReader::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which)
+{
+	uint64_t pos = buffer_pos + (gptr() - eback());
+	if (!(which & ios_base::in))
+		return pos_type(off_type(-1));
+	// tellg keeps the buffer
+	if (dir == ios_base::cur && !off)
+		return pos_type((off_type)pos);
+
+	off_type target = off;
+	if (dir == ios_base::cur)
+		target += (off_type)pos;
+	else if (dir == ios_base::end)
+		target += (off_type)total_size;
+	if (target < 0 || (uint64_t)target > total_size)
+		return pos_type(off_type(-1));
+
+	buffer_pos = (uint64_t)target;
+	index = 0;
+	extent_pos = 0;
+	setg(nullptr, nullptr, nullptr);
+	return pos_type(target);
+}
+
+ExtentReader::pos_type ExtentReader::seekpos(pos_type pos, ios_base::openmode which)
+{
+	return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+ExtentWriter::ExtentWriter(ostream& file, const vector<SparseExtent>& extents)
+	: file{ file }, extents{ extents }, buffer(SPARSE_BUFFER_SIZE)
+{
+	if (!extents.empty())
+		extent_left = extents[0].size;
+	setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+// the bytes past the last extent are counted but not written, so size() tells the caller
+void ExtentWriter::Flush()
+{
+	const char* data = pbase();
+	size_t size = pptr() - pbase();
+	written += size;
+
+	while (size) {
+		while (!extent_left && index + 1 < extents.size())
+			extent_left = extents[++index].size;
+		if (!extent_left)
+			break;
+
+		size_t len = (size_t)min<uint64_t>(size, extent_left);
+		file.seekp(extents[index].offset + extents[index].size - extent_left);
+		file.write(data, len);
+		data += len;
+		size -= len;
+		extent_left -= len;
+	}
+	setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+ExtentWriter::int_type ExtentWriter::overflow(int_type c)
+{
+	Flush();
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+int ExtentWriter::sync()
+{
+	Flush();
+	return file.flush() ? 0 : -1;
+}
+
+}
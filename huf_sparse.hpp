@@ -0,0 +1,96 @@
+#ifndef HUF_SPARSE_H
+#define HUF_SPARSE_H
+
+#include <stdint.h>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+// smaller files are encoded whole without looking for holes
+#define SPARSE_FILE_MIN 0x100000 // 1MiB
+// an aligned block of zeros this long is stored as a hole even where the file system has data
+#define SPARSE_BLOCK_SIZE 0x10000 // 64KiB
+
+namespace Huffman
+{
+
+#pragma pack(push, 1)
+
+// sparse file: FileHeader (data_size: number of extents), name, file size (uint64_t), SparseExtent * number of extents,
+// and the data of Encoding from the bytes of the extents put together. the rest of the file is holes
+struct SparseExtent
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+#pragma pack(pop)
+
+// the parts of the file holding data, in order. empty if the file has no hole of SPARSE_BLOCK_SIZE bytes
+// a file of holes only has one extent of size 0 at its end
+std::vector<SparseExtent> FindDataExtents(const std::filesystem::path& file_path, uint64_t file_size);
+
+// reads the extents written after the name, checking that they are in order and inside the file
+// return the file size
+uint64_t ReadSparseExtents(std::istream& src, size_t num_of_extents, std::vector<SparseExtent>& extents);
+
+void WriteSparseExtents(std::ostream& dst, uint64_t file_size, const std::vector<SparseExtent>& extents);
+
+// bytes of data in the extents
+uint64_t GetExtentsSize(const std::vector<SparseExtent>& extents);
+
+// The bytes of the extents of file, one after another, as a seekable source for Encoding
+class ExtentReader : public std::streambuf
+{
+public:
+	ExtentReader(std::istream& file, const std::vector<SparseExtent>& extents);
+
+protected:
+	int_type underflow() override;
+	std::streamsize showmanyc() override;
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+	std::istream& file;
+	const std::vector<SparseExtent>& extents;
+	uint64_t total_size = 0;
+	uint64_t buffer_pos = 0; // of eback() in the bytes of the extents
+	size_t index = 0; // extent holding buffer_pos
+	uint64_t extent_pos = 0; // of extents[index] in the bytes of the extents
+	std::vector<char> buffer;
+};
+
+// Writes the decoded bytes of the extents to their places in file, leaving the holes unwritten
+class ExtentWriter : public std::streambuf
+{
+public:
+	ExtentWriter(std::ostream& file, const std::vector<SparseExtent>& extents);
+
+	// bytes given so far, written or not
+	uint64_t size() const {
+		return written + (pptr() - pbase());
+	}
+
+protected:
+	int_type overflow(int_type c) override;
+	int sync() override;
+
+private:
+	void Flush();
+
+	std::ostream& file;
+	const std::vector<SparseExtent>& extents;
+	uint64_t written = 0;
+	size_t index = 0; // extent of the next byte
+	uint64_t extent_left = 0;
+	std::vector<char> buffer;
+};
+
+}
+
+#endif // HUF_SPARSE_H
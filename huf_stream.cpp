@@ -0,0 +1,262 @@
+#include "huf_stream.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace Huffman
+{
+
+// gives the output of the last step to out. return false if out is full before all of it is given
+static bool Drain(ostringstream& output, string& pending, size_t& pending_pos, char*& out, size_t& out_size)
+{
+	if (pending_pos == pending.size()) {
+		pending = output.str();
+		pending_pos = 0;
+		output.str({});
+	}
+
+	size_t size = min(out_size, pending.size() - pending_pos);
+	memcpy(out, pending.data() + pending_pos, size);
+	pending_pos += size;
+	out += size;
+	out_size -= size;
+	return pending_pos == pending.size();
+}
+
+StreamEncoder::StreamEncoder(const EncodingOptions& options)
+{
+	if (!options.lz77_level && !options.adaptive)
+		throw invalid_argument{ "Stream encoding needs adaptive or LZ77 coding" };
+
+	HufHeader header{};
+	if (options.lz77_level) {
+		lz77 = make_unique<Lz77Encoder>(options.lz77_level);
+		block_max = LZ77_BLOCK_SIZE;
+		token_bytes = 1;
+		header.lz77 = 1;
+	}
+	else {
+		adaptive = make_unique<AdaptiveCoder>(options.token_mode, true);
+		block_max = adaptive->block_max();
+		token_bytes = options.token_mode == TOKEN_MODE_16 ? Codec16::token_bytes : Codec8::token_bytes;
+		header.token_mode = options.token_mode;
+		header.adaptive = 1;
+	}
+	output.write((char*)&header, sizeof(HufHeader));
+}
+
+StreamEncoder::~StreamEncoder() = default;
+
+StreamState StreamEncoder::Encode(const char*& in, size_t& in_size, char*& out, size_t& out_size, StreamFlush flush)
+{
+	for (;;) {
+		if (!Drain(output, pending, pending_pos, out, out_size))
+			return StreamState::need_output;
+		if (finished)
+			return StreamState::finished;
+
+		size_t size = min(in_size, block_max - block.size());
+		block.append(in, size);
+		in += size;
+		in_size -= size;
+
+		if (block.size() == block_max) {
+			EncodeBlock(block.size());
+		}
+		else if (flush == StreamFlush::finish) {
+			if (!block.empty())
+				EncodeBlock(block.size());
+			if (lz77) {
+				Lz77Block last_block{};
+				output.write((char*)&last_block, sizeof(Lz77Block));
+			}
+			else {
+				AdaptiveBlock last_block{};
+				output.write((char*)&last_block, sizeof(AdaptiveBlock));
+			}
+			finished = true;
+		}
+		// an odd byte of 16 bit tokens waits for the next one
+		else if (flush == StreamFlush::block && block.size() >= token_bytes) {
+			EncodeBlock(block.size() - block.size() % token_bytes);
+		}
+		else {
+			return StreamState::need_input;
+		}
+	}
+}
+
+// codes block[0, size) to output
+void StreamEncoder::EncodeBlock(size_t size)
+{
+	if (lz77) {
+		lz77->EncodeBlock(output, block.data(), size);
+		block.erase(0, size);
+		return;
+	}
+
+	string rest = block.substr(size);
+	block.resize(size);
+	adaptive->EncodeBlock(output, block);
+	block = move(rest);
+	block_max = adaptive->block_max();
+}
+
+StreamDecoder::StreamDecoder() = default;
+
+StreamDecoder::~StreamDecoder() = default;
+
+// moves the input to the buffer of the part until it has need bytes. return false if the input ends first
+bool StreamDecoder::Fill(const char*& in, size_t& in_size)
+{
+	size_t size = min(in_size, need - input.size());
+	input.append(in, size);
+	in += size;
+	in_size -= size;
+	return input.size() == need;
+}
+
+// the parts of an LZ77 block are buffered whole, so their sizes are checked against what the encoder writes
+static void CheckLz77Stream(const HufHeader& header)
+{
+	if (header.adaptive || header.lz77 || header.token_count > LZ77_BLOCK_SIZE ||
+			header.data_size > header.token_count * MAX_CODE_LENGTH / BYTE_BITS + 1)
+		throw runtime_error{ "Invalid file: Invalid LZ77 block" };
+}
+
+static void CheckLz77Block(const Lz77Block& block)
+{
+	// at most 3 values of 31 extra bits per sequence
+	if (block.num_of_sequences > LZ77_BLOCK_SIZE + 1 || block.extra_size > (uint64_t)block.num_of_sequences * 3 * sizeof(uint32_t))
+		throw runtime_error{ "Invalid file: Invalid LZ77 block" };
+}
+
+// the buffer of the part is full: decodes it and sets the next part
+void StreamDecoder::NextPart()
+{
+	// the LZ77 streams only grow the buffer, the block is read at once after them
+	if (part == Part::lz77_header) {
+		istringstream is{ input.substr(input.size() - sizeof(HufHeader)) };
+		HufHeader stream_header = ReadHufHeader(is);
+		CheckLz77Stream(stream_header);
+		part = Part::lz77_stream;
+		need += GetEncodedSize(stream_header);
+		return;
+	}
+	if (part == Part::lz77_stream) {
+		if (++num_of_streams < 3) {
+			part = Part::lz77_header;
+			need += sizeof(HufHeader);
+		}
+		else {
+			part = Part::lz77_extra;
+			need += lz77_block.extra_size;
+		}
+		return;
+	}
+
+	istringstream is{ input };
+	input.clear();
+
+	switch (part) {
+	case Part::header:
+		header = ReadHufHeader(is);
+		if (header.lz77) {
+			lz77 = make_unique<Lz77Decoder>();
+			part = Part::lz77_block;
+			need = sizeof(Lz77Block);
+		}
+		else if (header.adaptive) {
+			adaptive = make_unique<AdaptiveCoder>((int)header.token_mode, false);
+			part = Part::adaptive_block;
+			need = sizeof(AdaptiveBlock);
+		}
+		else {
+			part = Part::records;
+			need = GetEncodedSize(header) - header.data_size;
+		}
+		break;
+
+	case Part::records:
+		data_decoder = make_unique<DataDecoder>(is, header);
+		data_left = header.data_size;
+		part = Part::data;
+		need = 0;
+		break;
+
+	case Part::adaptive_block:
+		if (!ReadAdaptiveBlock(is, adaptive_block)) {
+			part = Part::end;
+			break;
+		}
+		part = Part::adaptive_data;
+		need = adaptive_block.data_size;
+		break;
+
+	case Part::adaptive_data:
+		output << adaptive->DecodeBlock(is, adaptive_block);
+		part = Part::adaptive_block;
+		need = sizeof(AdaptiveBlock);
+		break;
+
+	case Part::lz77_block:
+		if (!ReadLz77Block(is, lz77_block)) {
+			part = Part::end;
+			break;
+		}
+		CheckLz77Block(lz77_block);
+		num_of_streams = 0;
+		part = Part::lz77_header;
+		need = sizeof(HufHeader);
+		break;
+
+	case Part::lz77_extra: {
+		string_view data = lz77->DecodeBlock(is, lz77_block);
+		output.write(data.data(), data.size());
+		part = Part::lz77_block;
+		need = sizeof(Lz77Block);
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+StreamState StreamDecoder::Decode(const char*& in, size_t& in_size, char*& out, size_t& out_size)
+{
+	for (;;) {
+		if (!Drain(output, pending, pending_pos, out, out_size))
+			return StreamState::need_output;
+		if (part == Part::end)
+			return StreamState::finished;
+
+		if (part != Part::data) {
+			if (!Fill(in, in_size))
+				return StreamState::need_input;
+			NextPart();
+			continue;
+		}
+
+		// a piece of the data at a time, so the output kept inside stays small
+		size_t size = (size_t)min<uint64_t>({ in_size, data_left, STREAM_PIECE_SIZE });
+		if (data_left && !size)
+			return StreamState::need_input;
+
+		// the data after the last token is skipped
+		bool more = data_decoder && data_decoder->Decode(in, size, output);
+		in += size;
+		in_size -= size;
+		data_left -= size;
+
+		if (!more) {
+			data_decoder.reset();
+			if (!data_left)
+				part = Part::end;
+		}
+	}
+}
+
+}
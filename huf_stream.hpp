@@ -0,0 +1,111 @@
+#ifndef HUF_STREAM_H
+#define HUF_STREAM_H
+
+#include <stdint.h>
+#include <string>
+#include <sstream>
+#include <memory>
+
+#include "huffman.hpp"
+#include "huf_lz77.hpp"
+
+// static data is decoded STREAM_PIECE_SIZE bytes at a time, so a call keeps at most 64KiB of output inside
+#define STREAM_PIECE_SIZE 0x1000 // 4KiB
+
+namespace Huffman
+{
+
+// why a call of StreamEncoder::Encode or StreamDecoder::Decode returned
+enum class StreamState
+{
+	need_input, // all of the input is used
+	need_output, // the output space is full
+	finished // the end of the data is written
+};
+
+// what the input of StreamEncoder::Encode holds
+enum class StreamFlush
+{
+	none, // more of the source follows, blocks are written when they are full
+	block, // the source so far is written now, in a shorter block
+	finish // the end of the source
+};
+
+// Encoding and decoding that never wait for a stream, so one thread can serve many of them.
+// A call codes what the input and the output space allow, and returns why it stopped.
+// in, in_size and out, out_size are advanced past the bytes used and written, the rest is kept for the next call.
+// The blocks are coded with the same code as Encoding and Decode, and the data is the same.
+
+class StreamEncoder
+{
+public:
+	// adaptive or LZ77 only, static data needs the whole source before its first byte
+	explicit StreamEncoder(const EncodingOptions& options);
+	~StreamEncoder();
+
+	StreamState Encode(const char*& in, size_t& in_size, char*& out, size_t& out_size, StreamFlush flush = StreamFlush::none);
+
+private:
+	void EncodeBlock(size_t size);
+
+	size_t block_max;
+	size_t token_bytes;
+	std::unique_ptr<AdaptiveCoder> adaptive;
+	std::unique_ptr<Lz77Encoder> lz77;
+	std::string block; // source not coded yet
+	bool finished = false;
+
+	std::ostringstream output; // of the last block
+	std::string pending; // output not given yet
+	size_t pending_pos = 0;
+};
+
+class StreamDecoder
+{
+public:
+	StreamDecoder();
+	~StreamDecoder();
+
+	// the data of one Encoding: static, adaptive or LZ77. the input after its end is not used
+	StreamState Decode(const char*& in, size_t& in_size, char*& out, size_t& out_size);
+
+private:
+	// what is read next
+	enum class Part
+	{
+		header,
+		records, // token records and sync points
+		data, // static data, decoded in pieces
+		adaptive_block,
+		adaptive_data,
+		lz77_block,
+		lz77_header, // of one of the three streams
+		lz77_stream,
+		lz77_extra,
+		end
+	};
+
+	bool Fill(const char*& in, size_t& in_size);
+	void NextPart();
+
+	Part part = Part::header;
+	std::string input; // of the part, until it has need bytes
+	size_t need = sizeof(HufHeader);
+
+	HufHeader header{};
+	uint64_t data_left = 0; // static data not given to data_decoder yet
+	std::unique_ptr<DataDecoder> data_decoder;
+	std::unique_ptr<AdaptiveCoder> adaptive;
+	AdaptiveBlock adaptive_block{};
+	std::unique_ptr<Lz77Decoder> lz77;
+	Lz77Block lz77_block{};
+	int num_of_streams = 0; // of the LZ77 block read so far
+
+	std::ostringstream output; // of the last part
+	std::string pending; // output not given yet
+	size_t pending_pos = 0;
+};
+
+}
+
+#endif // HUF_STREAM_H
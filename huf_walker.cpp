@@ -0,0 +1,208 @@
+#include "huf_walker.hpp"
+
+#include <deque>
+#include <stack>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cstring>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace Huffman
+{
+
+struct WalkNode
+{
+	ManifestEntry entry;
+	vector<WalkNode*> children;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// readdir reads the entries in batches (getdents64 on Linux) and d_type tells most types without stat
+static void ScanDirectory(const fs::path& dir_path, vector<ManifestEntry>& entries)
+{
+	int fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR* dir = (fd < 0) ? nullptr : fdopendir(fd);
+	if (!dir) {
+		error_code ec{ errno, system_category() };
+		if (fd >= 0) close(fd);
+		throw fs::filesystem_error{ "WalkPath", dir_path, ec };
+	}
+
+	while (dirent* d = readdir(dir)) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+
+		ManifestEntry entry{ dir_path / d->d_name, TYPE_UNSUPPORTED, 0, 0 };
+
+		struct stat st;
+		switch (d->d_type) {
+		case DT_DIR:
+			entry.type = TYPE_DIRECTORY;
+			break;
+		case DT_REG:
+		case DT_LNK:
+		case DT_UNKNOWN:
+			// size of a regular file, or the type a link points to
+			if (fstatat(dirfd(dir), d->d_name, &st, 0))
+				break;
+			if (S_ISDIR(st.st_mode)) {
+				entry.type = TYPE_DIRECTORY;
+			}
+			else if (S_ISREG(st.st_mode)) {
+				entry.type = TYPE_REGULAR_FILE;
+				entry.size = st.st_size;
+			}
+			break;
+		}
+		entries.push_back(move(entry));
+	}
+	closedir(dir);
+}
+
+#else
+
+// directory_entry caches what the directory listing returns, so this does not stat again
+static void ScanDirectory(const fs::path& dir_path, vector<ManifestEntry>& entries)
+{
+	for (const auto& dir_entry : fs::directory_iterator(dir_path)) {
+		ManifestEntry entry{ dir_entry.path(), TYPE_UNSUPPORTED, 0, 0 };
+
+		if (dir_entry.is_directory()) {
+			entry.type = TYPE_DIRECTORY;
+		}
+		else if (dir_entry.is_regular_file()) {
+			entry.type = TYPE_REGULAR_FILE;
+			entry.size = dir_entry.file_size();
+		}
+		entries.push_back(move(entry));
+	}
+}
+
+#endif
+
+static ManifestEntry MakeRootEntry(const fs::path& root_path)
+{
+	// "dir/" has no filename
+	fs::path path = root_path.has_filename() ? root_path : root_path.parent_path();
+	ManifestEntry entry{ path, TYPE_UNSUPPORTED, 0, 0 };
+
+	auto status = fs::status(path);
+	if (fs::is_directory(status)) {
+		entry.type = TYPE_DIRECTORY;
+	}
+	else if (fs::is_regular_file(status)) {
+		entry.type = TYPE_REGULAR_FILE;
+		entry.size = fs::file_size(path);
+	}
+	return entry;
+}
+
+Manifest WalkPath(const fs::path& root_path, unsigned num_of_threads)
+{
+	deque<WalkNode> nodes; // does not move the nodes when growing
+	nodes.push_back({ MakeRootEntry(root_path), {} });
+	WalkNode* root = &nodes.front();
+
+	if (root->entry.type == TYPE_DIRECTORY) {
+		mutex nodes_mutex;
+		condition_variable cv;
+		vector<WalkNode*> queue{ root };
+		size_t pending = 1; // directories queued or being scanned
+		exception_ptr error;
+
+		auto worker = [&]() {
+			unique_lock<mutex> lock{ nodes_mutex };
+			while (true) {
+				cv.wait(lock, [&]() { return !queue.empty() || !pending || error; });
+				if (queue.empty() || error)
+					break;
+
+				WalkNode* node = queue.back();
+				queue.pop_back();
+				lock.unlock();
+
+				vector<ManifestEntry> entries;
+				try {
+					ScanDirectory(node->entry.path, entries);
+				}
+				catch (...) {
+					lock.lock();
+					error = current_exception();
+					cv.notify_all();
+					break;
+				}
+
+				lock.lock();
+				node->entry.num_of_children = entries.size();
+				for (auto& entry : entries) {
+					nodes.push_back({ move(entry), {} });
+					WalkNode* child = &nodes.back();
+					node->children.push_back(child);
+					if (child->entry.type == TYPE_DIRECTORY) {
+						queue.push_back(child);
+						pending++;
+					}
+				}
+				pending--;
+				cv.notify_all();
+			}
+		};
+
+		if (!num_of_threads)
+			num_of_threads = max(thread::hardware_concurrency(), 1u);
+
+		vector<thread> threads;
+		for (unsigned i = 1; i < num_of_threads; i++)
+			threads.emplace_back(worker);
+		worker();
+		for (auto& t : threads)
+			t.join();
+
+		if (error)
+			rethrow_exception(error);
+	}
+
+	// preorder without recursion
+	Manifest manifest;
+	manifest.reserve(nodes.size());
+	manifest.push_back(move(root->entry));
+
+	stack<pair<WalkNode*, size_t>> node_stack;
+	node_stack.push({ root, 0 });
+	while (!node_stack.empty()) {
+		auto& [node, next] = node_stack.top();
+		if (next == node->children.size()) {
+			node_stack.pop();
+			continue;
+		}
+
+		WalkNode* child = node->children[next++];
+		manifest.push_back(move(child->entry));
+		if (manifest.back().type == TYPE_DIRECTORY)
+			node_stack.push({ child, 0 });
+	}
+	return manifest;
+}
+
+uintmax_t GetManifestSize(const Manifest& manifest)
+{
+	uintmax_t size = 0;
+	for (const auto& entry : manifest)
+		if (entry.type == TYPE_REGULAR_FILE)
+			size += entry.size;
+	return size;
+}
+
+}
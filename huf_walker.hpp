@@ -0,0 +1,33 @@
+#ifndef HUF_WALKER_H
+#define HUF_WALKER_H
+
+#include <stdint.h>
+#include <vector>
+#include <filesystem>
+
+#include "huffman.hpp"
+
+// neither a regular file nor a directory (after following symbolic links)
+#define TYPE_UNSUPPORTED 3
+
+namespace Huffman
+{
+
+struct ManifestEntry
+{
+	std::filesystem::path path;
+	uint8_t type; // TYPE_REGULAR_FILE, TYPE_DIRECTORY or TYPE_UNSUPPORTED
+	uintmax_t size; // regular file only
+	size_t num_of_children; // directory only, number of entries directly under it
+};
+
+// Scans the tree under root_path without recursion, using num_of_threads threads (0: number of cores).
+// The result is in preorder: a directory is followed by its children, and their children.
+Manifest WalkPath(const std::filesystem::path& root_path, unsigned num_of_threads = 0);
+
+// sum of the regular file sizes
+uintmax_t GetManifestSize(const Manifest& manifest);
+
+}
+
+#endif // HUF_WALKER_H
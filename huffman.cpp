@@ -1,444 +1,2242 @@
-#include "huffman.hpp"
-
-#include <queue>
-#include <stack>
-//#include <fstream>
-#include <memory>
-//#include <cstring>
-
-#define LEFT 0
-#define RIGHT 1
-//#define PREV 0
-//#define NEXT 1
-
-using namespace std;
-namespace fs = std::filesystem;
-
-//template <typename T>
-//struct greater<T*>
-//{
-//	bool operator()(const T* left, const T* right)
-//	{
-//		return *left > *right;
-//	}
-//};
-
-template <typename T>
-struct ptr_greater
-{
-	bool operator()(const T* left, const T* right)
-	{
-		return *left > *right;
-	}
-};
-
-namespace Huffman
-{
-
-size_t WritePath(ostream& os, const NameType* str)
-{
-	auto cur = str;
-	while (*cur) cur++;
-	os.write((char*)str, (cur - str) * sizeof(NameType));
-	return (cur - str);
-}
-
-static void BuildCodeTable(const HufNode* tree, size_t size, bool code[], vector<Code>& code_table);
-inline void FillTokenTable(istream& is, vector<size_t>& token_table);
-
-// preprocessing for encoding-----------------------------------------------
-inline void FillTokenTable(istream& is, vector<size_t>& token_table)
-{
-	while (is.peek() != EOF)
-		token_table[(token_t)is.get()]++;
-}
-
-vector<size_t> MakeTokenTable(istream& is)
-{
-	vector<size_t> token_table(TOKEN_MAX);
-
-	FillTokenTable(is, token_table);
-
-	return token_table;
-}
-
-// ޸   
-HufNode* MakePrefixTree(const vector<size_t>& token_table)
-{
-	priority_queue<HufNode*, vector<HufNode*>, ptr_greater<HufNode>> token_queue;
-
-	// ť ä
-	for (int i = 0; i < TOKEN_MAX; i++) {
-		if (token_table[i] > 0) {
-			TokenCount token_cnt{ i, token_table[i] };
-			token_queue.push(new HufNode{ token_cnt });
-		}
-	}
-
-	if (token_queue.empty()) return nullptr;
-
-	// Ʈ 
-	while (token_queue.size() > 1) {
-		HufNode* left = token_queue.top();
-		token_queue.pop();
-		HufNode* right = token_queue.top();
-		token_queue.pop();
-
-		HufNode* newNode = new HufNode{};
-
-		newNode->get().count = left->get().count + right->get().count;
-		newNode->set_link(LEFT, left);
-		newNode->set_link(RIGHT, right);
-
-		token_queue.push(newNode);
-	}
-	return token_queue.top();
-}
-
-vector<Code> MakeCodeTable(const HufNode* tree)
-{
-	bool code[TOKEN_MAX];
-	vector<Code> code_table(TOKEN_MAX);
-
-	if (tree) BuildCodeTable(tree, 0, code, code_table);
-
-	return code_table;
-}
-
-static void BuildCodeTable(const HufNode* node, size_t size, bool code[], vector<Code>& code_table)
-{
-	// Ʈ ڽ  2̰ų 0̹Ƿ   ˻ ʿ 
-	if (node->link(LEFT)) {
-		code[size] = LEFT;
-		BuildCodeTable(node->link(LEFT), size + 1, code, code_table);
-
-		code[size] = RIGHT;
-		BuildCodeTable(node->link(RIGHT), size + 1, code, code_table);
-	}
-	else {
-		for (int i = 0; i < size; i++)
-			code_table[node->get().token].code.set(i, code[i]);
-		code_table[node->get().token].size = size;
-	}
-}
-
-uint16_t BuildTokenRecords(const HufNode* node, TokenRecord token_records[])
-{
-	if (!node) return 0;
-
-	stack<const HufNode*> node_stack;
-	stack<token_t> level_stack;
-	uint16_t num_of_records = 0;
-
-	node_stack.push(node);
-	level_stack.push(0); //  0 .
-
-	while (!node_stack.empty()) {
-		node = node_stack.top();
-		node_stack.pop();
-		token_t level = level_stack.top();
-		level_stack.pop();
-
-		if (node->link(LEFT)) {
-			node_stack.push(node->link(RIGHT));
-			level_stack.push(level + 1);
-			node_stack.push(node->link(LEFT));
-			level_stack.push(level + 1);
-		}
-		else {
-			token_records[num_of_records].level = level;
-			token_records[num_of_records].token = node->get().token;
-
-			num_of_records++;
-		}
-	}
-	return num_of_records;
-}
-
-// ޸   
-HufNode* DecodeTokenRecords(const TokenRecord token_records[], uint16_t records_size)
-{
-	stack<HufNode*> tree_stack;
-
-	for (uint16_t i = 0; i < records_size; i++) {
-		HufNode* new_node = new HufNode{ token_records[i].token,
-										 token_records[i].level };
-		while (!tree_stack.empty() &&
-				tree_stack.top()->get().count == new_node->get().count) {
-			HufNode* left = tree_stack.top();
-			tree_stack.pop();
-			HufNode* right = new_node;
-
-			new_node = new HufNode{};
-			new_node->get().count = left->get().count - 1;
-			new_node->set_link(LEFT, left);
-			new_node->set_link(RIGHT, right);
-		}
-		tree_stack.push(new_node);
-	}
-
-	if (tree_stack.size() == 1)
-		return tree_stack.top();
-	else {
-		while (!tree_stack.empty()) {
-			DestroyPODNodes(tree_stack.top());
-			tree_stack.pop();
-		}
-		return nullptr;
-	}
-}
-
-// encoding process-------------------------------------------------------------
-
-int ConvertToHufCode(istream& is, ostream& os, const vector<Code>& code_table)
-{
-	token_t character = 0;
-	int current_bit = 0;
-
-	while (is.peek() != EOF) {
-		token_t idx = is.get();
-		for (int i = 0; i < code_table[idx].size; i++) {
-			character |= code_table[idx].code.test(i) << current_bit;
-			if (++current_bit == TOKEN_BITS) { // ϳ  ѹ ϰ ٲ 
-				os.put(character);
-				current_bit = character = 0;
-			}
-		}
-	}
-
-	if (current_bit)
-		os.put(character);
-
-	return (TOKEN_BITS - current_bit) % TOKEN_BITS;
-}
-
-void Encode(istream& is, ostream& os, const vector<Code>& code_table, const HufNode* tree)
-{
-	// ū ڵ 
-	TokenRecord token_records[TOKEN_MAX];
-	uint16_t records_size = BuildTokenRecords(tree, token_records);
-
-	//     Ȯ
-	HufHeader header{ 0, records_size };
-	auto header_pos = os.tellp();
-	os.write((char*)&header, sizeof(HufHeader));
-	
-	// Ʈ 
-	os.write((char*)token_records, sizeof(TokenRecord) * records_size);
-
-	//  ڵ ȯ
-	auto temp_os_pos = os.tellp();
-	header.padding_bits = ConvertToHufCode(is, os, code_table);
-
-	auto last_pos = os.tellp();
-	header.data_size = last_pos - temp_os_pos;
-
-	os.seekp(header_pos);
-	os.write((char*)&header, sizeof(HufHeader));
-	os.seekp(last_pos);
-}
-
-void Encoding(istream& is, ostream& os)
-{
-	auto first_pos = is.tellg();
-
-	// ū ̺
-	vector<size_t> token_table = MakeTokenTable(is);
-
-	// Ʈ
-	//PODNodeGuard<HufNode> tree{ MakePrefixTree(token_table) };
-	unique_ptr<HufNode, void(*)(HufNode*)> tree{ MakePrefixTree(token_table), &DestroyPODNodes };
-
-	/*if (!tree)
-		throw exception{ "Cannot build Huffman tree" };*/
-
-	//ڵ ̺
-	vector<Code> code_table = MakeCodeTable(tree.get());
-
-	// Ͽ 
-	is.clear();
-	is.seekg(first_pos);
-	Encode(is, os, code_table, tree.get());
-}
-
-void EncodeFile(const fs::path& file_path, ostream& os)
-{
-	ifstream is{ file_path, ios_base::binary };
-	if (!is.good()) {
-		auto ec = make_error_code(huf_errc::invalid_fstream);
-		throw fs::filesystem_error{ "EncodeFile", file_path, ec };
-	}
-
-	FileHeader header{ TYPE_REGULAR_FILE };
-	auto header_pos = os.tellp();
-	os.write((char*)&header, sizeof(FileHeader));
-
-	header.name_size = WritePath(os, file_path.filename().c_str());
-
-	if (header.name_size >= FILENAME_MAX)
-		throw out_of_range{ "Invalid file name length: " + to_string(header.name_size) };
-
-	Encoding(is, os);
-
-	auto current_pos = os.tellp();
-	os.seekp(header_pos);
-	os.write((char*)&header, sizeof(FileHeader));
-	os.seekp(current_pos);
-}
-
-void EncodeDirectory(const fs::path& dir_path, ostream& os)
-{
-	auto directory_iter = fs::directory_iterator(dir_path);
-
-	DirectoryHeader header{ TYPE_DIRECTORY };
-	auto header_pos = os.tellp();
-	os.write((char*)&header, sizeof(DirectoryHeader));
-
-	header.name_size = WritePath(os, dir_path.filename().c_str());
-
-	if (header.name_size >= FILENAME_MAX)
-		throw out_of_range{ "Invalid file name length: " + to_string(header.name_size) };
-
-	for (const auto& path : directory_iter) {
-		Compress(path, os);
-		header.data_size++;
-	}
-
-	auto current_pos = os.tellp();
-	os.seekp(header_pos);
-	os.write((char*)&header, sizeof(DirectoryHeader));
-	os.seekp(current_pos);
-}
-
-void Compress(const fs::path& path, ostream& os)
-{
-	if (fs::is_directory(path)) {
-		EncodeDirectory(path, os);
-	}
-	else if (fs::is_regular_file(path)) {
-		EncodeFile(path, os);
-	}
-	else {
-		error_code ec = make_error_code(huf_errc::invalid_file_type);
-		throw fs::filesystem_error{ "Compress", path, ec };
-	}
-}
-
-// decoding process-------------------------------------------------------------
-
-void ConvertToToken(std::istream& is, std::ostream& os, const HufNode* tree, int padding_bits, size_t max_len)
-{
-	if (!tree) return;
-	const HufNode* node = tree;
-
-	token_t bits = 0;
-	while (is.peek() != EOF && max_len--) {
-		bits = is.get();
-
-		for (uint8_t i = 0; i < TOKEN_BITS;) {
-			if (node->link(bits & RIGHT)) {
-				node = node->link(bits & RIGHT);
-				bits >>= 1;
-				i++;
-			}
-			else {
-				os.put(node->get().token);
-				node = tree;
-				if (is.peek() == EOF && (i + padding_bits) >= TOKEN_BITS)
-					break;
-			}
-		}
-	}
-	if (!node->link(bits & RIGHT))
-		os.put(node->get().token);
-}
-
-void Decode(istream& is, ostream& os)
-{
-	HufHeader header{};
-	is.read((char*)&header, sizeof(Header));
-
-	if (header.records_size > TOKEN_MAX)
-		throw out_of_range{ "Invalid file header: Invalid token records size: " + to_string(header.records_size) };
-
-	TokenRecord token_records[TOKEN_MAX];
-	is.read((char*)token_records, sizeof(TokenRecord) * header.records_size);
-	PODNodeGuard<HufNode> tree{ DecodeTokenRecords(token_records, header.records_size) };
-
-	if (!tree && header.records_size)
-		throw exception{ "Invalid file header: Invalid token records: Huffman tree build faild" };
-	
-	ConvertToToken(is, os, tree.get(), header.padding_bits, header.data_size);
-}
-
-void Decoding(istream& is, ostream& os)
-{
-	Decode(is, os);
-}
-
-void DecodeFile(istream& is, const fs::path& file_path)
-{
-	ofstream os{ file_path, ios_base::binary };
-
-	if (!os.good()) {
-		error_code ec = make_error_code(huf_errc::invalid_fstream);
-		throw fs::filesystem_error{ "DecodeFile", file_path, ec };
-	}
-	
-	Decoding(is, os);
-}
-
-void DecodeDirectory(istream& is, const fs::path& prefix, size_t num_of_file)
-{
-	fs::create_directory(prefix);
-
-	for (size_t i = 0; i < num_of_file; i++)
-		Decompress(is, prefix);
-}
-
-void Decompress(istream& is, const fs::path& prefix)
-{
-	Header header{};
-	is.read((char*)&header, sizeof(Header));
-
-	if (header.name_size >= FILENAME_MAX || !header.name_size)
-		throw out_of_range{ "Invalid file header: Invalid file name length: " + to_string(header.name_size) };
-
-	NameType name[FILENAME_MAX];
-	is.read((char*)name, sizeof(NameType) * header.name_size);
-	name[header.name_size] = 0;
-
-	switch (header.type) {
-	case TYPE_REGULAR_FILE:
-		DecodeFile(is, prefix / name);
-		break;
-	case TYPE_DIRECTORY:
-		DecodeDirectory(is, prefix / name, header.data_size);
-		break;
-	}
-}
-
-fs::path DecompressRetFilename(istream& is, const fs::path& prefix)
-{
-	Header header{};
-	is.read((char*)&header, sizeof(Header));
-
-	if (header.name_size >= FILENAME_MAX || !header.name_size)
-		throw out_of_range{ "Invalid file header: Invalid file name size: " + to_string(header.name_size) };
-
-	NameType name[FILENAME_MAX];
-	is.read((char*)name, sizeof(NameType) * header.name_size);
-	name[header.name_size] = 0;
-
-	switch (header.type) {
-	case TYPE_REGULAR_FILE:
-		DecodeFile(is, prefix / name);
-		break;
-	case TYPE_DIRECTORY:
-		DecodeDirectory(is, prefix / name, header.data_size);
-		break;
-	}
-	return name;
-}
-
+#include "huffman.hpp"
+#include "huf_cache.hpp"
+#include "huf_walker.hpp"
+#include "huf_lz77.hpp"
+#include "huf_ans.hpp"
+#include "huf_sparse.hpp"
+#include "huf_checkpoint.hpp"
+
+#include <queue>
+#include <stack>
+//#include <fstream>
+#include <memory>
+//#include <cstring>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <thread>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define LEFT 0
+#define RIGHT 1
+#define IO_BUFFER_SIZE 0x10000
+//#define PREV 0
+//#define NEXT 1
+
+using namespace std;
+namespace fs = std::filesystem;
+
+//template <typename T>
+//struct greater<T*>
+//{
+//	bool operator()(const T* left, const T* right)
+//	{
+//		return *left > *right;
+//	}
+//};
+
+template <typename T>
+struct ptr_greater
+{
+	bool operator()(const T* left, const T* right)
+	{
+		return *left > *right;
+	}
+};
+
+namespace Huffman
+{
+
+size_t WritePath(ostream& os, const NameType* str)
+{
+	auto cur = str;
+	while (*cur) cur++;
+	os.write((char*)str, (cur - str) * sizeof(NameType));
+	return (cur - str);
+}
+
+// reads a source IO_BUFFER_SIZE bytes at a time as tokens. the buffers are kept for the next source
+template <typename C>
+class TokenReader
+{
+public:
+	using Token = typename C::token_type;
+
+	// return number of tokens read, 0 at the end
+	size_t Read(istream& is)
+	{
+		if (in_buffer.empty()) {
+			in_buffer.resize(IO_BUFFER_SIZE);
+			tokens.resize(C::token_bytes == 1 ? 0 : IO_BUFFER_SIZE / C::token_bytes);
+		}
+
+		is.read(in_buffer.data(), in_buffer.size());
+		size_t size = is.gcount();
+
+		if constexpr (C::token_bytes == 1) {
+			return size;
+		}
+		else {
+			// an odd byte at the end is completed with zero
+			if (size % C::token_bytes) {
+				fill_n(in_buffer.begin() + size, C::token_bytes - size % C::token_bytes, 0);
+				size += C::token_bytes - size % C::token_bytes;
+				tail_padding = true;
+			}
+			const unsigned char* bytes = (const unsigned char*)in_buffer.data();
+			for (size_t n = 0; n < size / C::token_bytes; n++, bytes += C::token_bytes)
+				tokens[n] = (Token)(bytes[0] | bytes[1] << BYTE_BITS);
+			return size / C::token_bytes;
+		}
+	}
+
+	const Token* data() const
+	{
+		if constexpr (C::token_bytes == 1)
+			return (const Token*)in_buffer.data();
+		else
+			return tokens.data();
+	}
+
+	bool tail_padding = false; // cleared by the caller for a new source
+
+private:
+	vector<char> in_buffer;
+	vector<Token> tokens;
+};
+
+// gives the nodes of the trees returned to the caller, who destroys them with DestroyPODNodes
+template <typename Node>
+struct NodeHeap
+{
+	Node* New(const Node& node)
+	{
+		return new Node{ node };
+	}
+	void Release(Node* tree)
+	{
+		DestroyPODNodes(tree);
+	}
+};
+
+// Tables, tree nodes and buffers for one token width. Encoder and Decoder keep one for each width,
+// so they are allocated for the first source and only refilled for the next ones.
+template <typename C>
+class CodecContext
+{
+public:
+	using Node = typename C::Node;
+
+	CodecContext()
+		: nodes(2 * C::token_max - 1) {}
+
+	// same as the functions of the same name, with the buffers of the context
+	// num_of_threads: more than 1 reads the source in chunks and codes them in parallel, the output is the same
+	int ConvertToHufCode(istream& is, ostream& os, const vector<Code>& code_table, vector<uint64_t>* sync_points, size_t sync_interval);
+	void Encode(istream& is, ostream& os, const vector<Code>& code_table, const Node* tree, size_t token_count, bool tail_padding,
+				unsigned num_of_threads = 1);
+	void Encoding(istream& is, ostream& os, unsigned num_of_threads = 1);
+
+	void ConvertToToken(istream& is, ostream& os, const Node* tree, size_t data_size, size_t byte_count,
+						int first_bit, size_t skip_count);
+	// num_of_threads: more than 1 decodes chunks of the data in parallel, the output is the same
+	void Decode(istream& is, ostream& os, const HufHeader& header, unsigned num_of_threads = 1);
+	void DecodeRange(istream& is, ostream& os, const HufHeader& header, size_t first, size_t count);
+	// the data of ARCHIVE_VERSION_LEGACY, return the bytes written
+	uint64_t DecodeLegacy(istream& is, ostream& os, const LegacyHufHeader& header, unsigned num_of_threads);
+
+	// the tree walk of ConvertToToken over one piece of the data, from node
+	// return the node where the piece ends, the walk goes on from it with the next piece
+	// the tokens are written when the buffer is full, and by FlushTokens
+	const Node* DecodeBits(const char* data, size_t size, int first_bit, const Node* tree, const Node* node,
+						   size_t& byte_count, size_t& skip_count, ostream& os);
+	void FlushTokens(ostream& os);
+
+	// the tree is valid until the next call
+	const Node* ReadTokenRecords(istream& is, const HufHeader& header);
+
+private:
+	size_t CountTokens(istream& is, unsigned num_of_threads);
+	size_t ReadChunks(istream& is, unsigned num_of_threads);
+	int ConvertChunks(istream& is, ostream& os, const vector<Code>& code_table, vector<uint64_t>& sync_points, size_t sync_interval,
+					  unsigned num_of_threads);
+	uint64_t DecodeChunks(istream& is, ostream& os, const Node* tree, size_t data_size, size_t byte_count, unsigned num_of_threads,
+						  int padding_bits = 0);
+
+	TokenReader<C> reader;
+	vector<size_t> token_table;
+	vector<Code> codes;
+	vector<typename C::Record> token_records;
+	vector<uint64_t> sync_points;
+	PODNodePool<Node> nodes; // the tree of the current source
+	vector<Node*> work; // queue or stack of the nodes while a tree is built
+	vector<char> in_buffer;
+	vector<char> out_buffer;
+	size_t out_size = 0; // tokens of DecodeBits not written yet
+
+	// parallel coding: the chunks read at once, and the table, bit offset, code and sync points of each
+	vector<char> chunks;
+	vector<vector<size_t>> chunk_tables;
+	vector<uint64_t> chunk_offsets;
+	vector<vector<char>> chunk_codes;
+	vector<vector<uint64_t>> chunk_sync_points;
+	// parallel decoding: the tokens of each chunk, and the bit offsets of the token boundaries at its start
+	vector<vector<char>> chunk_tokens;
+	vector<vector<uint32_t>> chunk_boundaries;
+};
+
+template <typename C>
+static void BuildCodeTable(const typename C::Node* node, uint32_t size, uint32_t code, vector<Code>& code_table);
+
+template <typename C>
+static size_t GetTreeDepth(const typename C::Node* tree);
+
+// preprocessing for encoding-----------------------------------------------
+
+// return number of tokens
+template <typename C>
+static size_t CountTokens(istream& is, TokenReader<C>& reader, vector<size_t>& token_table)
+{
+	size_t token_count = 0;
+
+	while (size_t size = reader.Read(is)) {
+		const auto* tokens = reader.data();
+		for (size_t n = 0; n < size; n++)
+			token_table[tokens[n]]++;
+		token_count += size;
+	}
+	return token_count;
+}
+
+template <typename C>
+vector<size_t> MakeTokenTable(istream& is, bool* tail_padding)
+{
+	vector<size_t> token_table(C::token_max);
+	TokenReader<C> reader;
+
+	CountTokens<C>(is, reader, token_table);
+
+	if (tail_padding)
+		*tail_padding = reader.tail_padding;
+	return token_table;
+}
+
+// 메모리 누수 고려 없음
+// token_queue: a heap of the nodes, with the same operations as priority_queue
+template <typename C, typename Nodes>
+static typename C::Node* BuildPrefixTree(const vector<size_t>& token_table, Nodes& nodes, vector<typename C::Node*>& token_queue)
+{
+	using Node = typename C::Node;
+	ptr_greater<Node> greater;
+	token_queue.clear();
+
+	// 큐 채우기
+	for (size_t i = 0; i < C::token_max; i++) {
+		if (token_table[i] > 0) {
+			TokenCount<typename C::token_type> token_cnt{ (typename C::token_type)i, token_table[i] };
+			token_queue.push_back(nodes.New(Node{ token_cnt }));
+			push_heap(token_queue.begin(), token_queue.end(), greater);
+		}
+	}
+
+	if (token_queue.empty()) return nullptr;
+
+	// 트리 구성
+	while (token_queue.size() > 1) {
+		pop_heap(token_queue.begin(), token_queue.end(), greater);
+		Node* left = token_queue.back();
+		token_queue.pop_back();
+		pop_heap(token_queue.begin(), token_queue.end(), greater);
+		Node* right = token_queue.back();
+		token_queue.pop_back();
+
+		Node* newNode = nodes.New(Node{});
+
+		newNode->get().count = left->get().count + right->get().count;
+		newNode->set_link(LEFT, left);
+		newNode->set_link(RIGHT, right);
+
+		token_queue.push_back(newNode);
+		push_heap(token_queue.begin(), token_queue.end(), greater);
+	}
+	return token_queue.front();
+}
+
+// codes are at most C::max_code_length bits
+template <typename C, typename Nodes>
+static typename C::Node* BuildLimitedTree(const vector<size_t>& token_table, Nodes& nodes, vector<typename C::Node*>& token_queue)
+{
+	typename C::Node* tree = BuildPrefixTree<C>(token_table, nodes, token_queue);
+	if (GetTreeDepth<C>(tree) <= C::max_code_length)
+		return tree;
+
+	// halving the counts makes the tree flatter, all counts 1 give a depth of at most the token width
+	vector<size_t> flat_table = token_table;
+	while (GetTreeDepth<C>(tree) > C::max_code_length) {
+		nodes.Release(tree);
+		for (auto& count : flat_table)
+			count = (count + 1) / 2;
+		tree = BuildPrefixTree<C>(flat_table, nodes, token_queue);
+	}
+	return tree;
+}
+
+template <typename C>
+typename C::Node* MakePrefixTree(const vector<size_t>& token_table)
+{
+	NodeHeap<typename C::Node> nodes;
+	vector<typename C::Node*> token_queue;
+	return BuildLimitedTree<C>(token_table, nodes, token_queue);
+}
+
+// a Huffman tree is as deep as the log of the counts at most, so the recursion stays shallow
+template <typename C>
+static size_t GetTreeDepth(const typename C::Node* tree)
+{
+	if (!tree || !tree->link(LEFT)) return 0;
+
+	return 1 + max(GetTreeDepth<C>(tree->link(LEFT)), GetTreeDepth<C>(tree->link(RIGHT)));
+}
+
+template <typename C>
+static void FillCodeTable(const typename C::Node* tree, vector<Code>& code_table)
+{
+	code_table.assign(C::token_max, Code{});
+
+	if (tree) BuildCodeTable<C>(tree, 0, 0, code_table);
+}
+
+template <typename C>
+vector<Code> MakeCodeTable(const typename C::Node* tree)
+{
+	vector<Code> code_table;
+	FillCodeTable<C>(tree, code_table);
+	return code_table;
+}
+
+template <typename C>
+static void BuildCodeTable(const typename C::Node* node, uint32_t size, uint32_t code, vector<Code>& code_table)
+{
+	// 트리의 자식의 개수는 2개이거나 0개이므로 양쪽 다 검사할 필요 없음
+	if (node->link(LEFT)) {
+		BuildCodeTable<C>(node->link(LEFT), size + 1, code | (uint32_t)LEFT << size, code_table);
+		BuildCodeTable<C>(node->link(RIGHT), size + 1, code | (uint32_t)RIGHT << size, code_table);
+	}
+	else {
+		code_table[node->get().token].code = code;
+		code_table[node->get().token].size = size;
+	}
+}
+
+// leaves from the left, as the decoder rebuilds the tree
+template <typename C>
+static void AppendTokenRecords(const typename C::Node* node, uint8_t level, typename C::Record token_records[], uint32_t& num_of_records)
+{
+	if (node->link(LEFT)) {
+		AppendTokenRecords<C>(node->link(LEFT), level + 1, token_records, num_of_records);
+		AppendTokenRecords<C>(node->link(RIGHT), level + 1, token_records, num_of_records);
+	}
+	else {
+		token_records[num_of_records].level = level;
+		token_records[num_of_records].token = node->get().token;
+
+		num_of_records++;
+	}
+}
+
+template <typename C>
+uint32_t BuildTokenRecords(const typename C::Node* node, typename C::Record token_records[])
+{
+	uint32_t num_of_records = 0;
+
+	// 레벨은 0부터 시작함.
+	if (node) AppendTokenRecords<C>(node, 0, token_records, num_of_records);
+
+	return num_of_records;
+}
+
+// 메모리 누수 고려 없음
+template <typename C, typename Nodes>
+static typename C::Node* BuildTreeFromRecords(const typename C::Record token_records[], uint32_t records_size, Nodes& nodes,
+											  vector<typename C::Node*>& tree_stack)
+{
+	using Node = typename C::Node;
+	tree_stack.clear();
+
+	for (uint32_t i = 0; i < records_size; i++) {
+		Node* new_node = nodes.New(Node{ token_records[i].token,
+										 token_records[i].level });
+		while (!tree_stack.empty() &&
+				tree_stack.back()->get().count == new_node->get().count) {
+			Node* left = tree_stack.back();
+			tree_stack.pop_back();
+			Node* right = new_node;
+
+			new_node = nodes.New(Node{});
+			new_node->get().count = left->get().count - 1;
+			new_node->set_link(LEFT, left);
+			new_node->set_link(RIGHT, right);
+		}
+		tree_stack.push_back(new_node);
+	}
+
+	if (tree_stack.size() == 1)
+		return tree_stack.back();
+
+	for (Node* node : tree_stack)
+		nodes.Release(node);
+	return nullptr;
+}
+
+template <typename C>
+typename C::Node* DecodeTokenRecords(const typename C::Record token_records[], uint32_t records_size)
+{
+	NodeHeap<typename C::Node> nodes;
+	vector<typename C::Node*> tree_stack;
+	return BuildTreeFromRecords<C>(token_records, records_size, nodes, tree_stack);
+}
+
+// runs work(0) ~ work(n - 1) on n threads, this one included
+template <typename Work>
+static void RunParallel(size_t n, Work work)
+{
+	vector<thread> threads;
+	for (size_t i = 1; i < n; i++)
+		threads.emplace_back(work, i);
+	work(0);
+	for (auto& t : threads)
+		t.join();
+}
+
+template <typename C>
+static typename C::token_type GetToken(const unsigned char* bytes, size_t n)
+{
+	if constexpr (C::token_bytes == 1)
+		return bytes[n];
+	else
+		return (typename C::token_type)(bytes[n * 2] | bytes[n * 2 + 1] << BYTE_BITS);
+}
+
+// reads a chunk of PARALLEL_CHUNK_SIZE bytes for each thread, the last one may be shorter
+// return number of tokens read, 0 at the end
+template <typename C>
+size_t CodecContext<C>::ReadChunks(istream& is, unsigned num_of_threads)
+{
+	chunks.resize((size_t)num_of_threads * PARALLEL_CHUNK_SIZE + C::token_bytes);
+	is.read(chunks.data(), (size_t)num_of_threads * PARALLEL_CHUNK_SIZE);
+	size_t size = is.gcount();
+
+	// an odd byte at the end is completed with zero, as TokenReader does
+	if (size % C::token_bytes) {
+		fill_n(chunks.begin() + size, C::token_bytes - size % C::token_bytes, 0);
+		size += C::token_bytes - size % C::token_bytes;
+		reader.tail_padding = true;
+	}
+	return size / C::token_bytes;
+}
+
+// counts into token_table, each chunk on its own thread. return number of tokens
+template <typename C>
+size_t CodecContext<C>::CountTokens(istream& is, unsigned num_of_threads)
+{
+	token_table.assign(C::token_max, 0);
+	reader.tail_padding = false;
+
+	if (num_of_threads <= 1)
+		return Huffman::CountTokens<C>(is, reader, token_table);
+
+	const size_t chunk_tokens = PARALLEL_CHUNK_SIZE / C::token_bytes;
+	size_t token_count = 0;
+	chunk_tables.resize(num_of_threads);
+
+	while (size_t num_of_tokens = ReadChunks(is, num_of_threads)) {
+		size_t num_of_chunks = (num_of_tokens + chunk_tokens - 1) / chunk_tokens;
+		if (num_of_chunks > 1)
+			for (size_t i = 0; i < num_of_chunks; i++)
+				chunk_tables[i].assign(C::token_max, 0);
+
+		RunParallel(num_of_chunks, [&](size_t i) {
+			const unsigned char* bytes = (const unsigned char*)chunks.data() + i * PARALLEL_CHUNK_SIZE;
+			size_t size = min(chunk_tokens, num_of_tokens - i * chunk_tokens);
+			vector<size_t>& table = num_of_chunks > 1 ? chunk_tables[i] : token_table;
+			for (size_t n = 0; n < size; n++)
+				table[GetToken<C>(bytes, n)]++;
+		});
+
+		if (num_of_chunks > 1)
+			for (size_t i = 0; i < num_of_chunks; i++)
+				for (size_t t = 0; t < C::token_max; t++)
+					token_table[t] += chunk_tables[i][t];
+		token_count += num_of_tokens;
+	}
+	return token_count;
+}
+
+// encoding process-------------------------------------------------------------
+
+template <typename C>
+int CodecContext<C>::ConvertToHufCode(istream& is, ostream& os, const vector<Code>& code_table, vector<uint64_t>* sync_points,
+									  size_t sync_interval)
+{
+	out_buffer.resize(IO_BUFFER_SIZE + sizeof(uint64_t));
+	size_t out_size = 0;
+	uint64_t num_of_bytes = 0; // written to os
+
+	// codes are at most 32 bits, so bits never overflows
+	uint64_t bits = 0;
+	int num_of_bits = 0;
+	size_t until_sync = (sync_points && sync_interval) ? sync_interval : numeric_limits<size_t>::max();
+
+	while (size_t size = reader.Read(is)) {
+		const auto* tokens = reader.data();
+
+		for (size_t n = 0; n < size; n++) {
+			if (!until_sync--) {
+				sync_points->push_back((num_of_bytes + out_size) * BYTE_BITS + num_of_bits);
+				until_sync = sync_interval - 1;
+			}
+
+			const Code& code = code_table[tokens[n]];
+			bits |= (uint64_t)code.code << num_of_bits;
+			num_of_bits += code.size;
+			while (num_of_bits >= BYTE_BITS) {
+				out_buffer[out_size++] = (char)bits;
+				bits >>= BYTE_BITS;
+				num_of_bits -= BYTE_BITS;
+			}
+
+			if (out_size >= IO_BUFFER_SIZE) {
+				os.write(out_buffer.data(), out_size);
+				num_of_bytes += out_size;
+				out_size = 0;
+			}
+		}
+	}
+
+	if (num_of_bits)
+		out_buffer[out_size++] = (char)bits;
+	os.write(out_buffer.data(), out_size);
+
+	return (BYTE_BITS - num_of_bits) % BYTE_BITS;
+}
+
+template <typename C>
+int ConvertToHufCode(istream& is, ostream& os, const vector<Code>& code_table, vector<uint64_t>* sync_points, size_t sync_interval)
+{
+	return CodecContext<C>{}.ConvertToHufCode(is, os, code_table, sync_points, sync_interval);
+}
+
+// Same output as ConvertToHufCode. The bit length of each chunk is the sum of the code sizes of its tokens,
+// so the bit offset of every chunk is known before it is coded. Each thread codes its chunk into its own buffer,
+// starting at the bit of that offset in the first byte, and the buffers are joined by OR-ing the shared byte.
+template <typename C>
+int CodecContext<C>::ConvertChunks(istream& is, ostream& os, const vector<Code>& code_table, vector<uint64_t>& sync_points,
+								   size_t sync_interval, unsigned num_of_threads)
+{
+	const size_t chunk_tokens = PARALLEL_CHUNK_SIZE / C::token_bytes;
+	chunk_offsets.resize(num_of_threads + 1);
+	chunk_codes.resize(num_of_threads);
+	chunk_sync_points.resize(num_of_threads);
+
+	uint64_t bit_offset = 0; // of the chunks in the data
+	size_t token_offset = 0; // of the chunks in the source
+	char last_byte = 0; // the last byte written is not full, its bits are in this one
+
+	while (size_t num_of_tokens = ReadChunks(is, num_of_threads)) {
+		size_t num_of_chunks = (num_of_tokens + chunk_tokens - 1) / chunk_tokens;
+		auto chunk_bytes = [&](size_t i) {
+			return (const unsigned char*)chunks.data() + i * PARALLEL_CHUNK_SIZE;
+		};
+		auto chunk_size = [&](size_t i) {
+			return min(chunk_tokens, num_of_tokens - i * chunk_tokens);
+		};
+
+		// bit lengths
+		RunParallel(num_of_chunks, [&](size_t i) {
+			const unsigned char* bytes = chunk_bytes(i);
+			uint64_t num_of_bits = 0;
+			for (size_t n = 0, size = chunk_size(i); n < size; n++)
+				num_of_bits += code_table[GetToken<C>(bytes, n)].size;
+			chunk_offsets[i + 1] = num_of_bits;
+		});
+
+		chunk_offsets[0] = bit_offset;
+		for (size_t i = 0; i < num_of_chunks; i++) {
+			chunk_offsets[i + 1] += chunk_offsets[i];
+			size_t code_size = (chunk_offsets[i + 1] + BYTE_BITS - 1) / BYTE_BITS - chunk_offsets[i] / BYTE_BITS;
+			chunk_codes[i].resize(code_size + sizeof(uint64_t));
+			chunk_sync_points[i].clear();
+		}
+
+		RunParallel(num_of_chunks, [&](size_t i) {
+			const unsigned char* bytes = chunk_bytes(i);
+			char* out = chunk_codes[i].data();
+			size_t out_size = 0;
+			uint64_t base = chunk_offsets[i] / BYTE_BITS * BYTE_BITS;
+
+			uint64_t bits = 0;
+			int num_of_bits = chunk_offsets[i] % BYTE_BITS;
+
+			// tokens before a sync point, the first token of the source has none
+			size_t first_token = token_offset + i * chunk_tokens;
+			size_t until_sync = numeric_limits<size_t>::max();
+			if (sync_interval)
+				until_sync = first_token % sync_interval ? sync_interval - first_token % sync_interval : first_token ? 0 : sync_interval;
+
+			for (size_t n = 0, size = chunk_size(i); n < size; n++) {
+				if (!until_sync--) {
+					chunk_sync_points[i].push_back(base + out_size * BYTE_BITS + num_of_bits);
+					until_sync = sync_interval - 1;
+				}
+
+				const Code& code = code_table[GetToken<C>(bytes, n)];
+				bits |= (uint64_t)code.code << num_of_bits;
+				num_of_bits += code.size;
+				while (num_of_bits >= BYTE_BITS) {
+					out[out_size++] = (char)bits;
+					bits >>= BYTE_BITS;
+					num_of_bits -= BYTE_BITS;
+				}
+			}
+			out[out_size] = (char)bits;
+		});
+
+		for (size_t i = 0; i < num_of_chunks; i++) {
+			char* out = chunk_codes[i].data();
+			if (chunk_offsets[i] % BYTE_BITS)
+				out[0] |= last_byte;
+
+			size_t full_size = chunk_offsets[i + 1] / BYTE_BITS - chunk_offsets[i] / BYTE_BITS;
+			os.write(out, full_size);
+			last_byte = out[full_size];
+
+			sync_points.insert(sync_points.end(), chunk_sync_points[i].begin(), chunk_sync_points[i].end());
+		}
+
+		bit_offset = chunk_offsets[num_of_chunks];
+		token_offset += num_of_tokens;
+	}
+
+	if (bit_offset % BYTE_BITS)
+		os.write(&last_byte, 1);
+
+	return (BYTE_BITS - bit_offset % BYTE_BITS) % BYTE_BITS;
+}
+
+template <typename C>
+void CodecContext<C>::Encode(istream& is, ostream& os, const vector<Code>& code_table, const Node* tree,
+							 size_t token_count, bool tail_padding, unsigned num_of_threads)
+{
+	// 토큰 리코드 빌드
+	token_records.resize(C::token_max);
+	uint32_t records_size = BuildTokenRecords<C>(tree, token_records.data());
+
+	// 마지막에 쓰기위한 헤더 공간 확보
+	HufHeader header{};
+	header.token_mode = C::token_mode;
+	header.tail_padding = tail_padding;
+	header.records_size = records_size;
+	header.token_count = token_count;
+	header.sync_interval = SYNC_INTERVAL;
+	auto header_pos = os.tellp();
+	os.write((char*)&header, sizeof(HufHeader));
+
+	// 트리 저장
+	os.write((char*)token_records.data(), sizeof(typename C::Record) * records_size);
+
+	// space for sync points
+	sync_points.assign(GetNumOfSyncPoints(header), 0);
+	auto sync_pos = os.tellp();
+	os.write((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size());
+	sync_points.clear();
+
+	// 허프만 코드로 변환
+	auto temp_os_pos = os.tellp();
+	if (num_of_threads > 1)
+		header.padding_bits = ConvertChunks(is, os, code_table, sync_points, header.sync_interval, num_of_threads);
+	else
+		header.padding_bits = ConvertToHufCode(is, os, code_table, &sync_points, header.sync_interval);
+
+	auto last_pos = os.tellp();
+	header.data_size = last_pos - temp_os_pos;
+
+	os.seekp(header_pos);
+	os.write((char*)&header, sizeof(HufHeader));
+	os.seekp(sync_pos);
+	os.write((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size());
+	os.seekp(last_pos);
+}
+
+template <typename C>
+void Encode(istream& is, ostream& os, const vector<Code>& code_table, const typename C::Node* tree,
+			size_t token_count, bool tail_padding)
+{
+	CodecContext<C>{}.Encode(is, os, code_table, tree, token_count, tail_padding);
+}
+
+template <typename C>
+void CodecContext<C>::Encoding(istream& is, ostream& os, unsigned num_of_threads)
+{
+	auto first_pos = is.tellg();
+
+	// 토큰 테이블
+	size_t token_count = CountTokens(is, num_of_threads);
+	bool tail_padding = reader.tail_padding;
+
+	// 트리
+	nodes.Clear();
+	const Node* tree = BuildLimitedTree<C>(token_table, nodes, work);
+
+	//코드 테이블
+	FillCodeTable<C>(tree, codes);
+
+	// 파일에 출력
+	is.clear();
+	is.seekg(first_pos);
+
+	// ANS instead of the codes when it is estimated smaller from the same counts
+	if constexpr (C::token_bytes == 1) {
+		uint64_t code_bits = 0;
+		size_t num_of_records = 0;
+		for (size_t i = 0; i < C::token_max; i++) {
+			code_bits += (uint64_t)token_table[i] * codes[i].size;
+			num_of_records += token_table[i] != 0;
+		}
+		uint64_t code_size = code_bits / BYTE_BITS + 1 + sizeof(typename C::Record) * num_of_records;
+
+		vector<uint32_t> ans_counts = NormalizeAnsCounts(token_table);
+		if (num_of_records > 1 && EstimateAnsSize(token_table, ans_counts, token_count) < code_size) {
+			EncodeAns(is, os, ans_counts, token_count);
+			return;
+		}
+	}
+
+	Encode(is, os, codes, tree, token_count, tail_padding, num_of_threads);
+}
+
+template <typename C>
+void Encoding(istream& is, ostream& os)
+{
+	CodecContext<C>{}.Encoding(is, os);
+}
+
+// counts of the tokens so far. the encoder and the decoder update it with the same blocks, so they build the same trees
+template <typename C>
+class AdaptiveModel
+{
+public:
+	explicit AdaptiveModel(bool has_code_table)
+		: token_table(C::token_max, 1), nodes(2 * C::token_max - 1), has_code_table{ has_code_table }
+	{
+		// every token has a code from the start
+		Rebuild();
+	}
+
+	const typename C::Node* tree() const
+	{
+		return tree_root;
+	}
+	const vector<Code>& code_table() const
+	{
+		return codes;
+	}
+
+	// adds the tokens of a source block
+	void Update(const string& block)
+	{
+		const unsigned char* bytes = (const unsigned char*)block.data();
+		for (size_t n = 0; n + C::token_bytes <= block.size(); n += C::token_bytes) {
+			if constexpr (C::token_bytes == 1)
+				token_table[bytes[n]]++;
+			else
+				token_table[bytes[n] | bytes[n + 1] << BYTE_BITS]++;
+		}
+		num_of_pending += block.size() / C::token_bytes;
+
+		// rebuilding costs more with a larger alphabet, so it is done less often as the counts settle
+		if (num_of_pending >= min(num_of_tokens, C::token_max * ADAPTIVE_REBUILD_RATIO))
+			Rebuild();
+	}
+
+private:
+	void Rebuild()
+	{
+		num_of_tokens += num_of_pending;
+		num_of_pending = 0;
+
+		size_t total = 0;
+		for (size_t count : token_table)
+			total += count;
+
+		// older blocks weigh less, every count stays at least 1
+		if (total > ADAPTIVE_COUNT_MAX)
+			for (auto& count : token_table)
+				count = (count + 1) / 2;
+
+		nodes.Clear();
+		tree_root = BuildLimitedTree<C>(token_table, nodes, work);
+		if (has_code_table)
+			FillCodeTable<C>(tree_root, codes);
+	}
+
+	vector<size_t> token_table;
+	PODNodePool<typename C::Node> nodes;
+	vector<typename C::Node*> work;
+	const typename C::Node* tree_root = nullptr;
+	vector<Code> codes;
+	bool has_code_table;
+	size_t num_of_tokens = 0; // counted when the tree was built
+	size_t num_of_pending = 0; // counted after that
+};
+
+// reads up to max_size bytes, but only waits while block is empty or ends in the middle of a token
+// return false at the end of src
+static bool ReadAvailable(istream& is, string& block, size_t max_size, size_t token_bytes)
+{
+	streambuf* buf = is.rdbuf();
+	block.clear();
+
+	while (block.size() < max_size) {
+		streamsize avail = buf->in_avail();
+		if (avail > 0) {
+			size_t size = block.size();
+			block.resize(min<size_t>(max_size, size + avail));
+			buf->sgetn(&block[size], block.size() - size);
+			continue;
+		}
+		if (!block.empty() && block.size() % token_bytes == 0)
+			return true;
+
+		int c = buf->sbumpc();
+		if (c == EOF)
+			return false;
+		block.push_back((char)c);
+	}
+	return true;
+}
+
+// the model and the buffers of one token width
+template <typename C>
+struct AdaptiveCoder::State
+{
+	explicit State(bool encoding)
+		: model{ encoding } {}
+
+	void EncodeBlock(ostream& os, const string& block)
+	{
+		istringstream block_is{ block };
+		ostringstream data_os;
+		context.ConvertToHufCode(block_is, data_os, model.code_table(), nullptr, 0);
+		data = data_os.str();
+
+		AdaptiveBlock block_header{ (uint32_t)block.size(), (uint32_t)data.size() };
+		os.write((char*)&block_header, sizeof(AdaptiveBlock));
+		os.write(data.data(), data.size());
+
+		model.Update(block);
+	}
+
+	const string& DecodeBlock(istream& is, const AdaptiveBlock& block)
+	{
+		ostringstream block_os;
+		context.ConvertToToken(is, block_os, model.tree(), block.data_size, block.byte_count, 0, 0);
+		data = block_os.str();
+
+		model.Update(data);
+		return data;
+	}
+
+	AdaptiveModel<C> model;
+	CodecContext<C> context;
+	string data; // of the last block
+};
+
+AdaptiveCoder::AdaptiveCoder(int token_mode, bool encoding)
+{
+	if (token_mode == TOKEN_MODE_16)
+		state16 = make_unique<State<Codec16>>(encoding);
+	else
+		state8 = make_unique<State<Codec8>>(encoding);
+}
+
+AdaptiveCoder::~AdaptiveCoder() = default;
+
+void AdaptiveCoder::EncodeBlock(ostream& os, const string& block)
+{
+	if (state16)
+		state16->EncodeBlock(os, block);
+	else
+		state8->EncodeBlock(os, block);
+	next_block_max = min<size_t>(next_block_max * 2, ADAPTIVE_BLOCK_MAX);
+}
+
+const string& AdaptiveCoder::DecodeBlock(istream& is, const AdaptiveBlock& block)
+{
+	return state16 ? state16->DecodeBlock(is, block) : state8->DecodeBlock(is, block);
+}
+
+template <typename C>
+void EncodeAdaptive(istream& is, ostream& os)
+{
+	HufHeader header{};
+	header.token_mode = C::token_mode;
+	header.adaptive = 1;
+	os.write((char*)&header, sizeof(HufHeader));
+
+	AdaptiveCoder coder{ C::token_mode, true };
+	string block;
+
+	for (bool more = true; more;) {
+		more = ReadAvailable(is, block, coder.block_max(), C::token_bytes);
+		if (block.empty())
+			break;
+
+		coder.EncodeBlock(os, block);
+		os.flush();
+	}
+
+	AdaptiveBlock last_block{};
+	os.write((char*)&last_block, sizeof(AdaptiveBlock));
+	os.flush();
+}
+
+// the context of a token width is created when it is first needed
+template <typename C>
+static CodecContext<C>& GetContext(unique_ptr<CodecContext<C>>& context)
+{
+	if (!context)
+		context = make_unique<CodecContext<C>>();
+	return *context;
+}
+
+Encoder::Encoder() = default;
+
+Encoder::~Encoder() = default;
+
+void Encoder::Encoding(istream& is, ostream& os, const EncodingOptions& options)
+{
+	if (options.lz77_level)
+		EncodeLz77(is, os, options.lz77_level);
+	else if (options.adaptive && options.token_mode == TOKEN_MODE_16)
+		EncodeAdaptive<Codec16>(is, os);
+	else if (options.adaptive)
+		EncodeAdaptive<Codec8>(is, os);
+	else if (options.token_mode == TOKEN_MODE_16)
+		GetContext(context16).Encoding(is, os, options.num_of_threads);
+	else
+		GetContext(context8).Encoding(is, os, options.num_of_threads);
+}
+
+void Encoding(istream& is, ostream& os, const EncodingOptions& options)
+{
+	if (options.encoder)
+		options.encoder->Encoding(is, os, options);
+	else
+		Encoder{}.Encoding(is, os, options);
+}
+
+void EncodeFile(const fs::path& file_path, ostream& os, const CompressOptions& options)
+{
+	ifstream is{ file_path, ios_base::binary };
+	if (!is.good()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "EncodeFile", file_path, ec };
+	}
+
+	// only the data of a sparse file is encoded
+	is.seekg(0, ios_base::end);
+	uint64_t file_size = (uint64_t)is.tellg();
+	is.seekg(0);
+	vector<SparseExtent> extents;
+	if (file_size >= SPARSE_FILE_MIN)
+		extents = FindDataExtents(file_path, file_size);
+
+	FileHeader header{ TYPE_REGULAR_FILE, 0, extents.size() };
+	auto header_pos = os.tellp();
+	os.write((char*)&header, sizeof(FileHeader));
+
+	header.name_size = WritePath(os, file_path.filename().c_str());
+
+	if (header.name_size >= FILENAME_MAX)
+		throw out_of_range{ "Invalid file name length: " + to_string(header.name_size) };
+
+	unique_ptr<ExtentReader> extent_reader;
+	unique_ptr<istream> extent_is;
+	if (!extents.empty()) {
+		WriteSparseExtents(os, file_size, extents);
+		extent_reader = make_unique<ExtentReader>(is, extents);
+		extent_is = make_unique<istream>(extent_reader.get());
+	}
+	istream& src = extent_is ? *extent_is : is;
+
+	if (options.cache)
+		options.cache->Encoding(file_path, src, os, options);
+	else
+		Encoding(src, os, options);
+
+	auto current_pos = os.tellp();
+	os.seekp(header_pos);
+	os.write((char*)&header, sizeof(FileHeader));
+	os.seekp(current_pos);
+}
+
+void EncodeSolidBlock(const vector<fs::path>& file_paths, ostream& os, const CompressOptions& options)
+{
+	SolidBlockHeader header{ TYPE_SOLID_BLOCK, 0, file_paths.size() };
+	os.write((char*)&header, sizeof(SolidBlockHeader));
+
+	string block;
+	for (const auto& file_path : file_paths) {
+		ifstream is{ file_path, ios_base::binary };
+		if (!is.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "EncodeSolidBlock", file_path, ec };
+		}
+
+		size_t offset = block.size();
+		block.append(istreambuf_iterator<char>{ is }, istreambuf_iterator<char>{});
+
+		auto name = file_path.filename().native();
+		if (name.size() >= FILENAME_MAX)
+			throw out_of_range{ "Invalid file name length: " + to_string(name.size()) };
+
+		SolidEntry entry{ (uint16_t)name.size(), block.size() - offset };
+		os.write((char*)&entry, sizeof(SolidEntry));
+		WritePath(os, name.c_str());
+	}
+
+	istringstream block_is{ block };
+	Encoding(block_is, os, options);
+}
+
+void Compress(const fs::path& path, ostream& os, const CompressOptions& options)
+{
+	Compress(WalkPath(path), os, options);
+}
+
+void WriteArchiveHeader(ostream& os)
+{
+	ArchiveHeader header{ ARCHIVE_MAGIC, ARCHIVE_VERSION };
+	os.write((char*)&header, sizeof(ArchiveHeader));
+}
+
+uint32_t ReadArchiveHeader(istream& is)
+{
+	auto archive_pos = is.tellg();
+	ArchiveHeader header{};
+	bool has_header = is.read((char*)&header, sizeof(ArchiveHeader)) && (header.magic == ARCHIVE_MAGIC || header.magic == STREAM_MAGIC);
+	if (!has_header) {
+		// the old layout starts with its first entry
+		is.clear();
+		is.seekg(archive_pos);
+		return ARCHIVE_VERSION_LEGACY;
+	}
+
+	if (header.magic == STREAM_MAGIC)
+		throw runtime_error{ "Invalid file header: a stream without file names, it is decoded from standard input" };
+	if (header.version != ARCHIVE_VERSION)
+		throw runtime_error{ "Invalid file header: unsupported archive version: " + to_string(header.version) };
+
+	return header.version;
+}
+
+void WriteStreamHeader(ostream& os)
+{
+	ArchiveHeader header{ STREAM_MAGIC, ARCHIVE_VERSION };
+	os.write((char*)&header, sizeof(ArchiveHeader));
+}
+
+void ReadStreamHeader(istream& is)
+{
+	ArchiveHeader header{};
+	if (!is.read((char*)&header, sizeof(ArchiveHeader)) || header.magic != STREAM_MAGIC)
+		throw runtime_error{ "Invalid stream header: not a stream, an archive is decoded from its file" };
+	if (header.version != ARCHIVE_VERSION)
+		throw runtime_error{ "Invalid stream header: unsupported version: " + to_string(header.version) };
+}
+
+void ReadEntryHeader(istream& is, uint32_t version, Header& header)
+{
+	if (version == ARCHIVE_VERSION_LEGACY) {
+		LegacyHeader legacy{};
+		if (!is.read((char*)&legacy, sizeof(LegacyHeader)))
+			throw runtime_error{ "Invalid file header: header is truncated" };
+
+		// checked before the name size is narrowed to the field of Header
+		if (legacy.name_size >= FILENAME_MAX)
+			throw out_of_range{ "Invalid file header: Invalid file name length: " + to_string(legacy.name_size) };
+
+		// a file of the old layout is never sparse
+		header = Header{ legacy.type, legacy.name_size, legacy.type == TYPE_DIRECTORY ? legacy.data_size : 0 };
+	}
+	else if (!is.read((char*)&header, sizeof(Header))) {
+		throw runtime_error{ "Invalid file header: header is truncated" };
+	}
+
+	bool has_name = header.type != TYPE_SOLID_BLOCK;
+	if (header.name_size >= FILENAME_MAX || !header.name_size == has_name)
+		throw out_of_range{ "Invalid file header: Invalid file name length: " + to_string(header.name_size) };
+}
+
+static void FlushSolidFiles(DirectoryFrame& frame, ostream& os, const CompressOptions& options)
+{
+	if (frame.solid_files.size() == 1)
+		EncodeFile(frame.solid_files.front(), os, options);
+	else
+		EncodeSolidBlock(frame.solid_files, os, options);
+	frame.header.data_size++;
+	frame.solid_files.clear();
+	frame.solid_size = 0;
+}
+
+// the entries of the manifest from first, in the directories of frames
+static void EncodeEntries(const Manifest& manifest, size_t first, vector<DirectoryFrame>& frames, ostream& os,
+						  const CompressOptions& options)
+{
+	// all the files are encoded with the buffers of one encoder
+	if (!options.encoder) {
+		Encoder encoder;
+		CompressOptions encoder_options = options;
+		encoder_options.encoder = &encoder;
+		EncodeEntries(manifest, first, frames, os, encoder_options);
+		return;
+	}
+
+	for (size_t n = first; n < manifest.size(); n++) {
+		const auto& entry = manifest[n];
+		DirectoryFrame* parent = frames.empty() ? nullptr : &frames.back();
+		if (parent)
+			parent->remaining--;
+
+		if (entry.type == TYPE_DIRECTORY) {
+			DirectoryFrame frame{ os.tellp(), { TYPE_DIRECTORY, 0, 0 }, entry.num_of_children, {}, 0 };
+			os.write((char*)&frame.header, sizeof(DirectoryHeader));
+
+			frame.header.name_size = WritePath(os, entry.path.filename().c_str());
+
+			if (frame.header.name_size >= FILENAME_MAX)
+				throw out_of_range{ "Invalid file name length: " + to_string(frame.header.name_size) };
+
+			frames.push_back(move(frame));
+		}
+		else if (entry.type == TYPE_REGULAR_FILE) {
+			if (parent && options.solid && entry.size < SOLID_FILE_MAX) {
+				parent->solid_files.push_back(entry.path);
+				parent->solid_size += entry.size;
+				if (parent->solid_size >= SOLID_BLOCK_MAX)
+					FlushSolidFiles(*parent, os, options);
+			}
+			else {
+				EncodeFile(entry.path, os, options);
+				if (parent)
+					parent->header.data_size++;
+			}
+		}
+		else {
+			error_code ec = make_error_code(huf_errc::invalid_file_type);
+			throw fs::filesystem_error{ "Compress", entry.path, ec };
+		}
+
+		// write the headers of the finished directories
+		while (!frames.empty() && !frames.back().remaining) {
+			DirectoryFrame& frame = frames.back();
+			if (!frame.solid_files.empty())
+				FlushSolidFiles(frame, os, options);
+
+			auto current_pos = os.tellp();
+			os.seekp(frame.header_pos);
+			os.write((char*)&frame.header, sizeof(DirectoryHeader));
+			os.seekp(current_pos);
+
+			frames.pop_back();
+			if (!frames.empty())
+				frames.back().header.data_size++;
+		}
+
+		if (options.checkpoint)
+			options.checkpoint->Update(os, frames, n + 1);
+	}
+}
+
+void EncodeDirectory(const fs::path& dir_path, ostream& os, const CompressOptions& options)
+{
+	vector<DirectoryFrame> frames;
+	EncodeEntries(WalkPath(dir_path), 0, frames, os, options);
+}
+
+void Compress(const Manifest& manifest, ostream& os, const CompressOptions& options)
+{
+	vector<DirectoryFrame> frames;
+	size_t first = options.checkpoint ? options.checkpoint->Restore(frames) : 0;
+
+	// the archive of an interrupted run has its header
+	if (!first)
+		WriteArchiveHeader(os);
+
+	// the cache entries of the files written before are saved with the ones of this run
+	if (options.cache) {
+		for (size_t n = 0; n < first; n++) {
+			if (manifest[n].type == TYPE_REGULAR_FILE)
+				options.cache->Keep(manifest[n].path);
+		}
+	}
+	EncodeEntries(manifest, first, frames, os, options);
+}
+
+// decoding process-------------------------------------------------------------
+
+// drops the bytes written to it, for data decoded only for its size
+class NullBuffer : public streambuf
+{
+protected:
+	streamsize xsputn(const char*, streamsize size) override
+	{
+		return size;
+	}
+
+	int_type overflow(int_type c) override
+	{
+		return traits_type::not_eof(c);
+	}
+};
+
+template <typename C>
+void CodecContext<C>::ConvertToToken(istream& is, ostream& os, const Node* tree, size_t data_size, size_t byte_count,
+									 int first_bit, size_t skip_count)
+{
+	if (!tree || !byte_count) return;
+
+	out_buffer.resize(IO_BUFFER_SIZE);
+	size_t out_max = min<size_t>(byte_count, IO_BUFFER_SIZE);
+
+	// a tree of one token has no code
+	if (!tree->link(LEFT)) {
+		for (size_t n = 0; n < out_max; n++)
+			out_buffer[n] = (char)(tree->get().token >> (skip_count + n) % C::token_bytes * BYTE_BITS);
+		for (; byte_count > out_max; byte_count -= out_max)
+			os.write(out_buffer.data(), out_max);
+		os.write(out_buffer.data(), byte_count);
+		is.ignore(data_size);
+		return;
+	}
+
+	in_buffer.resize(IO_BUFFER_SIZE);
+	const Node* node = tree;
+	out_size = 0; // left by a walk that threw
+
+	while (data_size && byte_count) {
+		size_t in_size = min(data_size, in_buffer.size());
+		if (!is.read(in_buffer.data(), in_size))
+			throw runtime_error{ "Invalid file: compressed data is truncated" };
+		data_size -= in_size;
+
+		node = DecodeBits(in_buffer.data(), in_size, first_bit, tree, node, byte_count, skip_count, os);
+		first_bit = 0;
+	}
+	FlushTokens(os);
+
+	if (byte_count)
+		throw runtime_error{ "Invalid file: compressed data is truncated" };
+
+	// the rest of the data is not needed (range)
+	if (data_size)
+		is.seekg(data_size, ios_base::cur);
+}
+
+template <typename C>
+const typename C::Node* CodecContext<C>::DecodeBits(const char* data, size_t size, int first_bit, const Node* tree, const Node* node,
+													size_t& byte_count, size_t& skip_count, ostream& os)
+{
+	out_buffer.resize(IO_BUFFER_SIZE);
+	char* out = out_buffer.data();
+
+	// kept in locals, the stores to out could change them otherwise
+	size_t out_pos = out_size;
+	size_t bytes_left = byte_count;
+	size_t skip_left = skip_count;
+
+	for (size_t n = 0; n < size && bytes_left; n++) {
+		token_t bits = (token_t)data[n] >> first_bit;
+		for (int i = first_bit; i < BYTE_BITS && bytes_left; i++) {
+			node = node->link(bits & RIGHT);
+			bits >>= 1;
+			if (!node->link(LEFT)) {
+				auto token = node->get().token;
+				node = tree;
+				for (unsigned b = 0; b < C::token_bytes; b++) {
+					if (skip_left) {
+						skip_left--;
+						continue;
+					}
+					out[out_pos++] = (char)(token >> b * BYTE_BITS);
+					if (out_pos == IO_BUFFER_SIZE) {
+						os.write(out, out_pos);
+						out_pos = 0;
+					}
+					if (!--bytes_left) break;
+				}
+			}
+		}
+		first_bit = 0;
+	}
+
+	out_size = out_pos;
+	byte_count = bytes_left;
+	skip_count = skip_left;
+	return node;
+}
+
+template <typename C>
+void CodecContext<C>::FlushTokens(ostream& os)
+{
+	os.write(out_buffer.data(), out_size);
+	out_size = 0;
+}
+
+// walks the tree from bit first of data until a token starts at or after bit last, or the data ends in a token
+// the tokens are appended to tokens[0, num_of_tokens * token_bytes), which grows as needed
+// boundaries: if not null, the bit offsets after first of the tokens starting in the first PARALLEL_SYNC_WINDOW bits
+// return the bit where the walk stopped
+template <typename C>
+static uint64_t DecodeChunk(const char* data, uint64_t data_bits, uint64_t first, uint64_t last, const typename C::Node* tree,
+							size_t tree_depth, vector<char>& tokens, size_t& num_of_tokens, vector<uint32_t>* boundaries)
+{
+	// a token whose code may pass the end of the data is walked with a check at each bit
+	uint64_t safe_bits = data_bits > tree_depth ? data_bits - tree_depth : 0;
+	uint64_t pos = first;
+	size_t out_pos = num_of_tokens * C::token_bytes;
+
+	while (pos < last) {
+		if (boundaries && pos - first < PARALLEL_SYNC_WINDOW)
+			boundaries->push_back((uint32_t)(pos - first));
+
+		const typename C::Node* node = tree;
+		if (pos < safe_bits) {
+			do {
+				node = node->link((token_t)data[pos / BYTE_BITS] >> pos % BYTE_BITS & RIGHT);
+				pos++;
+			} while (node->link(LEFT));
+		}
+		else {
+			do {
+				if (pos == data_bits)
+					break;
+				node = node->link((token_t)data[pos / BYTE_BITS] >> pos % BYTE_BITS & RIGHT);
+				pos++;
+			} while (node->link(LEFT));
+			if (node->link(LEFT))
+				break;
+		}
+
+		if (out_pos + C::token_bytes > tokens.size())
+			tokens.resize(max<size_t>(tokens.size() * 2, IO_BUFFER_SIZE));
+		auto token = node->get().token;
+		for (unsigned b = 0; b < C::token_bytes; b++)
+			tokens[out_pos++] = (char)(token >> b * BYTE_BITS);
+	}
+
+	num_of_tokens = out_pos / C::token_bytes;
+	return pos;
+}
+
+// Same output as ConvertToToken. The data is read num_of_threads chunks of PARALLEL_CHUNK_SIZE bytes at a time,
+// and each thread decodes one chunk from its first bit as if a token started there. Then the decode of each chunk
+// goes on into the next one until it meets a token boundary of the next one, from where their tokens are the same.
+// A Huffman code finds the boundaries again after a few tokens, so the tokens of the next chunk before that one
+// are dropped and the rest are kept. The decode of the first chunk starts at a token, so all the joined ones do.
+// byte_count max: all the tokens of the data, whose codes end padding_bits before the end of the last byte (old layout)
+// return the bytes written
+template <typename C>
+uint64_t CodecContext<C>::DecodeChunks(istream& is, ostream& os, const Node* tree, size_t data_size, size_t byte_count,
+									   unsigned num_of_threads, int padding_bits)
+{
+	const uint64_t chunk_bits = (uint64_t)PARALLEL_CHUNK_SIZE * BYTE_BITS;
+	size_t tree_depth = GetTreeDepth<C>(tree);
+	// the last chunk reads on to the end of the token at its end
+	size_t overlap = (tree_depth + BYTE_BITS - 1) / BYTE_BITS;
+
+	chunk_tokens.resize(num_of_threads);
+	chunk_boundaries.resize(num_of_threads);
+	vector<uint64_t> chunk_first(num_of_threads); // bit of the first token decoded
+	vector<uint64_t> chunk_stop(num_of_threads); // bit where the decode stopped, a token starts there
+	vector<size_t> chunk_sizes(num_of_threads); // tokens decoded
+	vector<size_t> chunk_skips(num_of_threads); // tokens before the boundary shared with the chunk before
+
+	size_t size = 0; // bytes in chunks, from the byte of the first bit
+	uint64_t first_bit = 0;
+	bool to_end = byte_count == numeric_limits<size_t>::max();
+	uint64_t written = 0;
+
+	while (byte_count) {
+		size_t round_size = (size_t)num_of_threads * PARALLEL_CHUNK_SIZE + overlap;
+		chunks.resize(round_size);
+		size_t read_size = (size_t)min<uint64_t>(round_size - size, data_size);
+		if (!is.read(chunks.data() + size, read_size))
+			throw runtime_error{ "Invalid file: compressed data is truncated" };
+		data_size -= read_size;
+		size += read_size;
+
+		const char* data = chunks.data();
+		uint64_t data_bits = (uint64_t)size * BYTE_BITS - (data_size ? 0 : padding_bits);
+		uint64_t round_bits = data_size ? data_bits - (uint64_t)overlap * BYTE_BITS : data_bits;
+		size_t num_of_chunks = (size_t)max<uint64_t>((round_bits + chunk_bits - 1) / chunk_bits, 1);
+
+		RunParallel(num_of_chunks, [&](size_t i) {
+			chunk_first[i] = i ? i * chunk_bits : first_bit;
+			chunk_sizes[i] = 0;
+			chunk_skips[i] = 0;
+			chunk_boundaries[i].clear();
+			chunk_stop[i] = DecodeChunk<C>(data, data_bits, chunk_first[i], min((i + 1) * chunk_bits, round_bits), tree, tree_depth,
+										   chunk_tokens[i], chunk_sizes[i], i ? &chunk_boundaries[i] : nullptr);
+		});
+
+		// joins each chunk to the next one, from the first
+		for (size_t i = 0; i + 1 < num_of_chunks; i++) {
+			const auto& boundaries = chunk_boundaries[i + 1];
+			uint64_t pos = chunk_stop[i];
+			size_t n = 0;
+
+			for (;;) {
+				while (n < boundaries.size() && chunk_first[i + 1] + boundaries[n] < pos)
+					n++;
+				if (n < boundaries.size() && chunk_first[i + 1] + boundaries[n] == pos) {
+					chunk_skips[i + 1] = n;
+					break;
+				}
+				if (n == boundaries.size()) {
+					// not met in the window, the next chunk is decoded again from the right bit
+					chunk_first[i + 1] = pos;
+					chunk_sizes[i + 1] = 0;
+					chunk_stop[i + 1] = DecodeChunk<C>(data, data_bits, pos, max(pos, min((i + 2) * chunk_bits, round_bits)), tree,
+													   tree_depth, chunk_tokens[i + 1], chunk_sizes[i + 1], nullptr);
+					break;
+				}
+				pos = DecodeChunk<C>(data, data_bits, pos, pos + 1, tree, tree_depth, chunk_tokens[i], chunk_sizes[i], nullptr);
+			}
+		}
+
+		for (size_t i = 0; i < num_of_chunks && byte_count; i++) {
+			size_t skip = chunk_skips[i] * C::token_bytes;
+			size_t len = min(byte_count, chunk_sizes[i] * C::token_bytes - skip);
+			os.write(chunk_tokens[i].data() + skip, len);
+			byte_count -= len;
+			written += len;
+		}
+
+		if (!data_size)
+			break;
+
+		// the next round starts at the token after the last one
+		uint64_t stop = chunk_stop[num_of_chunks - 1];
+		size -= (size_t)(stop / BYTE_BITS);
+		copy_n(chunks.begin() + (size_t)(stop / BYTE_BITS), size, chunks.begin());
+		first_bit = stop % BYTE_BITS;
+	}
+
+	if (byte_count && !to_end)
+		throw runtime_error{ "Invalid file: compressed data is truncated" };
+	return written;
+}
+
+template <typename C>
+void ConvertToToken(istream& is, ostream& os, const typename C::Node* tree, size_t data_size, size_t byte_count,
+					int first_bit, size_t skip_count)
+{
+	CodecContext<C>{}.ConvertToToken(is, os, tree, data_size, byte_count, first_bit, skip_count);
+}
+
+#define INSTANTIATE_CODEC(C) \
+	template vector<size_t> MakeTokenTable<C>(istream& is, bool* tail_padding); \
+	template C::Node* MakePrefixTree<C>(const vector<size_t>& token_table); \
+	template vector<Code> MakeCodeTable<C>(const C::Node* tree); \
+	template uint32_t BuildTokenRecords<C>(const C::Node* tree, C::Record token_records[]); \
+	template C::Node* DecodeTokenRecords<C>(const C::Record token_records[], uint32_t records_size); \
+	template int ConvertToHufCode<C>(istream& is, ostream& os, const vector<Code>& code_table, \
+									 vector<uint64_t>* sync_points, size_t sync_interval); \
+	template void Encode<C>(istream& is, ostream& os, const vector<Code>& code_table, const C::Node* tree, \
+							size_t token_count, bool tail_padding); \
+	template void Encoding<C>(istream& is, ostream& os); \
+	template void EncodeAdaptive<C>(istream& is, ostream& os); \
+	template void ConvertToToken<C>(istream& is, ostream& os, const C::Node* tree, size_t data_size, size_t byte_count, \
+									int first_bit, size_t skip_count);
+
+INSTANTIATE_CODEC(Codec8)
+INSTANTIATE_CODEC(Codec16)
+
+HufHeader ReadHufHeader(istream& is)
+{
+	HufHeader header{};
+	if (!is.read((char*)&header, sizeof(HufHeader)))
+		throw runtime_error{ "Invalid file header: header is truncated" };
+
+	size_t token_max = header.token_mode == TOKEN_MODE_16 ? Codec16::token_max : Codec8::token_max;
+	if (header.records_size > token_max)
+		throw out_of_range{ "Invalid file header: Invalid token records size: " + to_string(header.records_size) };
+
+	if (header.tail_padding && (header.token_mode != TOKEN_MODE_16 || !header.token_count))
+		throw runtime_error{ "Invalid file header: Invalid tail padding" };
+
+	if (header.ans && (header.token_mode != TOKEN_MODE_8 || header.adaptive || header.lz77))
+		throw runtime_error{ "Invalid file header: Invalid ANS data" };
+
+	return header;
+}
+
+size_t GetNumOfSyncPoints(const HufHeader& header)
+{
+	if (!header.sync_interval || !header.token_count)
+		return 0;
+	return (header.token_count - 1) / header.sync_interval;
+}
+
+static size_t GetTokenBytes(const HufHeader& header)
+{
+	return header.token_mode == TOKEN_MODE_16 ? Codec16::token_bytes : Codec8::token_bytes;
+}
+
+uint64_t GetDecodedSize(const HufHeader& header)
+{
+	return (uint64_t)header.token_count * GetTokenBytes(header) - header.tail_padding;
+}
+
+// the data is not read in one pass
+static bool HasDecodedSize(const HufHeader& header)
+{
+	return !header.adaptive && !header.lz77;
+}
+
+uint64_t GetEncodedSize(const HufHeader& header)
+{
+	size_t record_size = header.ans ? sizeof(AnsRecord) : 1 + GetTokenBytes(header);
+	return record_size * (uint64_t)header.records_size +
+		sizeof(uint64_t) * GetNumOfSyncPoints(header) + header.data_size;
+}
+
+template <typename C>
+const typename C::Node* CodecContext<C>::ReadTokenRecords(istream& is, const HufHeader& header)
+{
+	token_records.resize(C::token_max);
+	if (!is.read((char*)token_records.data(), sizeof(typename C::Record) * header.records_size))
+		throw runtime_error{ "Invalid file header: token records are truncated" };
+
+	nodes.Clear();
+	const Node* tree = BuildTreeFromRecords<C>(token_records.data(), header.records_size, nodes, work);
+
+	if (!tree && header.records_size)
+		throw exception{ "Invalid file header: Invalid token records: Huffman tree build faild" };
+	return tree;
+}
+
+static LegacyHufHeader ReadLegacyHufHeader(istream& is)
+{
+	LegacyHufHeader header{};
+	if (!is.read((char*)&header, sizeof(LegacyHufHeader)))
+		throw runtime_error{ "Invalid file header: header is truncated" };
+
+	if (header.records_size > Codec8::token_max)
+		throw out_of_range{ "Invalid file header: Invalid token records size: " + to_string(header.records_size) };
+
+	if (header.padding_bits && !header.data_size)
+		throw runtime_error{ "Invalid file header: Invalid padding bits" };
+
+	return header;
+}
+
+static void SkipLegacyData(istream& is)
+{
+	LegacyHufHeader header = ReadLegacyHufHeader(is);
+	is.seekg(sizeof(Codec8::Record) * header.records_size + header.data_size, ios_base::cur);
+}
+
+bool ReadAdaptiveBlock(istream& is, AdaptiveBlock& block)
+{
+	if (!is.read((char*)&block, sizeof(AdaptiveBlock)))
+		throw runtime_error{ "Invalid file: adaptive block is truncated" };
+
+	if (block.byte_count > ADAPTIVE_BLOCK_MAX)
+		throw out_of_range{ "Invalid file: Invalid adaptive block size: " + to_string(block.byte_count) };
+
+	return block.byte_count;
+}
+
+// skips the blocks and returns their size after decoding
+static uint64_t SkipAdaptiveData(istream& is)
+{
+	uint64_t size = 0;
+	AdaptiveBlock block;
+	while (ReadAdaptiveBlock(is, block)) {
+		is.seekg(block.data_size, ios_base::cur);
+		size += block.byte_count;
+	}
+	return size;
+}
+
+// writes bytes [first, first + count). the blocks before them are decoded too, to follow the model
+static void DecodeAdaptive(istream& is, ostream& os, int token_mode, size_t first, size_t count)
+{
+	AdaptiveCoder coder{ token_mode, false };
+	uint64_t last = first + min(count, numeric_limits<size_t>::max() - first);
+	uint64_t offset = 0; // of the block in the decoded data
+	AdaptiveBlock block;
+
+	for (; ReadAdaptiveBlock(is, block); offset += block.byte_count) {
+		// nothing after the range is needed
+		if (offset >= last) {
+			is.seekg(block.data_size, ios_base::cur);
+			continue;
+		}
+
+		const string& data = coder.DecodeBlock(is, block);
+
+		uint64_t begin = max<uint64_t>(first, offset);
+		uint64_t end = min<uint64_t>(last, offset + block.byte_count);
+		if (begin < end) {
+			os.write(data.data() + (begin - offset), end - begin);
+			os.flush();
+		}
+	}
+}
+
+template <typename C>
+void CodecContext<C>::Decode(istream& is, ostream& os, const HufHeader& header, unsigned num_of_threads)
+{
+	const Node* tree = ReadTokenRecords(is, header);
+	is.ignore(sizeof(uint64_t) * GetNumOfSyncPoints(header));
+
+	// a tree of one token has no code
+	if (num_of_threads > 1 && header.data_size > PARALLEL_CHUNK_SIZE && tree && tree->link(LEFT))
+		DecodeChunks(is, os, tree, header.data_size, GetDecodedSize(header), num_of_threads);
+	else
+		ConvertToToken(is, os, tree, header.data_size, GetDecodedSize(header), 0, 0);
+}
+
+template <typename C>
+void CodecContext<C>::DecodeRange(istream& is, ostream& os, const HufHeader& header, size_t first, size_t count)
+{
+	const Node* tree = ReadTokenRecords(is, header);
+
+	sync_points.resize(GetNumOfSyncPoints(header));
+	is.read((char*)sync_points.data(), sizeof(uint64_t) * sync_points.size());
+
+	auto data_pos = is.tellg();
+	auto end_pos = data_pos + (streamoff)header.data_size;
+
+	size_t decoded_size = GetDecodedSize(header);
+	first = min(first, decoded_size);
+	count = min(count, decoded_size - first);
+
+	// nearest sync point before first
+	size_t first_token = first / C::token_bytes;
+	size_t sync_index = header.sync_interval ? min<size_t>(first_token / header.sync_interval, sync_points.size()) : 0;
+	uint64_t bit_offset = sync_index ? sync_points[sync_index - 1] : 0;
+	size_t sync_token = sync_index * (size_t)header.sync_interval;
+
+	if (bit_offset / BYTE_BITS > header.data_size)
+		throw out_of_range{ "Invalid file header: Invalid sync point" };
+
+	if (count) {
+		is.seekg(data_pos + (streamoff)(bit_offset / BYTE_BITS));
+		ConvertToToken(is, os, tree, header.data_size - bit_offset / BYTE_BITS, count,
+			bit_offset % BYTE_BITS, first - sync_token * C::token_bytes);
+	}
+	is.seekg(end_pos);
+}
+
+// the token records and codes of the old layout are the same, only the number of tokens is not stored
+template <typename C>
+uint64_t CodecContext<C>::DecodeLegacy(istream& is, ostream& os, const LegacyHufHeader& header, unsigned num_of_threads)
+{
+	HufHeader records_header{};
+	records_header.records_size = header.records_size;
+	const Node* tree = ReadTokenRecords(is, records_header);
+	if (!tree)
+		return 0;
+
+	// a tree of one token has no code, and its count was not stored: one token is written, as the old decoder did
+	if (!tree->link(LEFT)) {
+		os.put((char)tree->get().token);
+		is.ignore(header.data_size);
+		return 1;
+	}
+
+	return DecodeChunks(is, os, tree, header.data_size, numeric_limits<size_t>::max(), num_of_threads, header.padding_bits);
+}
+
+// the tree and the walk of one token width
+template <typename C>
+struct DataDecoder::State
+{
+	State(istream& is, const HufHeader& header)
+		: byte_count{ GetDecodedSize(header) }, data_left{ header.data_size }
+	{
+		if (header.ans)
+			ans = make_unique<AnsDecoder>(is, header);
+		else
+			tree = node = context.ReadTokenRecords(is, header);
+		is.ignore(sizeof(uint64_t) * GetNumOfSyncPoints(header));
+	}
+
+	bool Decode(const char* data, size_t size, ostream& os)
+	{
+		if (ans && byte_count) {
+			size = min<size_t>(size, data_left);
+			data_left -= size;
+			ans->Decode(data, size, 0, byte_count, skip_count, os);
+
+			if (byte_count && !data_left)
+				throw runtime_error{ "Invalid file: compressed data is truncated" };
+			return byte_count;
+		}
+
+		if (!tree || !byte_count)
+			return false;
+
+		// a tree of one token has no code
+		if (!tree->link(LEFT)) {
+			size_t count = min<size_t>(byte_count, IO_BUFFER_SIZE);
+			for (size_t n = 0; n < count; n++)
+				os.put((char)(tree->get().token >> n % C::token_bytes * BYTE_BITS));
+			byte_count -= count;
+			return byte_count;
+		}
+
+		size = min<size_t>(size, data_left);
+		data_left -= size;
+		node = context.DecodeBits(data, size, 0, tree, node, byte_count, skip_count, os);
+		context.FlushTokens(os);
+
+		if (byte_count && !data_left)
+			throw runtime_error{ "Invalid file: compressed data is truncated" };
+		return byte_count;
+	}
+
+	CodecContext<C> context;
+	unique_ptr<AnsDecoder> ans; // instead of the tree
+	const typename C::Node* tree = nullptr;
+	const typename C::Node* node = nullptr; // where the last piece ended
+	size_t byte_count; // not written yet
+	size_t skip_count = 0;
+	uint64_t data_left; // not given yet
+};
+
+DataDecoder::DataDecoder(istream& is, const HufHeader& header)
+{
+	if (header.token_mode == TOKEN_MODE_16)
+		state16 = make_unique<State<Codec16>>(is, header);
+	else
+		state8 = make_unique<State<Codec8>>(is, header);
+}
+
+DataDecoder::~DataDecoder() = default;
+
+bool DataDecoder::Decode(const char* data, size_t size, ostream& os)
+{
+	return state16 ? state16->Decode(data, size, os) : state8->Decode(data, size, os);
+}
+
+Decoder::Decoder(unsigned num_of_threads)
+	: num_of_threads{ max(num_of_threads, 1u) }
+{
+	name.reserve(FILENAME_MAX);
+}
+
+Decoder::~Decoder() = default;
+
+void Decoder::Decode(istream& is, ostream& os, const HufHeader& header)
+{
+	if (header.lz77)
+		DecodeLz77(is, os);
+	else if (header.adaptive)
+		DecodeAdaptive(is, os, header.token_mode, 0, numeric_limits<size_t>::max());
+	else if (header.ans)
+		DecodeAns(is, os, header);
+	else if (header.token_mode == TOKEN_MODE_16)
+		GetContext(context16).Decode(is, os, header, num_of_threads);
+	else
+		GetContext(context8).Decode(is, os, header, num_of_threads);
+}
+
+void Decoder::DecodeRange(istream& is, ostream& os, const HufHeader& header, size_t first, size_t count)
+{
+	if (header.lz77)
+		DecodeLz77(is, os, first, count);
+	else if (header.adaptive)
+		DecodeAdaptive(is, os, header.token_mode, first, count);
+	else if (header.ans)
+		DecodeAns(is, os, header, first, count);
+	else if (header.token_mode == TOKEN_MODE_16)
+		GetContext(context16).DecodeRange(is, os, header, first, count);
+	else
+		GetContext(context8).DecodeRange(is, os, header, first, count);
+}
+
+uint64_t Decoder::DecodeLegacy(istream& is, ostream& os)
+{
+	return GetContext(context8).DecodeLegacy(is, os, ReadLegacyHufHeader(is), num_of_threads);
+}
+
+void Decode(istream& is, ostream& os, const HufHeader& header)
+{
+	Decoder{}.Decode(is, os, header);
+}
+
+void DecodeRange(istream& is, ostream& os, const HufHeader& header, size_t first, size_t count)
+{
+	Decoder{}.DecodeRange(is, os, header, first, count);
+}
+
+void Decode(istream& is, ostream& os)
+{
+	Decode(is, os, ReadHufHeader(is));
+}
+
+void Decoding(istream& is, ostream& os)
+{
+	Decode(is, os);
+}
+
+// creates the file with its final size so that writing does not grow it
+// holes: only the size is set, the parts that are not written stay holes of the file system
+static void PreallocateFile(const fs::path& file_path, uintmax_t size, bool holes = false)
+{
+	{
+		ofstream os{ file_path, ios_base::binary };
+		if (!os.good()) {
+			error_code ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "DecodeFile", file_path, ec };
+		}
+	}
+	if (!size) return;
+
+#if defined(__unix__)
+	int fd = holes ? -1 : open(file_path.c_str(), O_WRONLY);
+	if (fd >= 0) {
+		int err = posix_fallocate(fd, 0, size);
+		close(fd);
+		if (!err) return;
+	}
+#endif
+	fs::resize_file(file_path, size);
+}
+
+void Decoder::DecodeFile(istream& is, const fs::path& file_path)
+{
+	// the size of the old layout is known only after decoding
+	bool legacy = archive_version == ARCHIVE_VERSION_LEGACY;
+	HufHeader header = legacy ? HufHeader{} : ReadHufHeader(is);
+	PreallocateFile(file_path, !legacy && HasDecodedSize(header) ? GetDecodedSize(header) : 0);
+
+	ofstream os{ file_path, ios_base::in | ios_base::binary };
+
+	if (!os.good()) {
+		error_code ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "DecodeFile", file_path, ec };
+	}
+	
+	if (legacy)
+		DecodeLegacy(is, os);
+	else
+		Decode(is, os, header);
+}
+
+void DecodeFile(istream& is, const fs::path& file_path)
+{
+	Decoder{}.DecodeFile(is, file_path);
+}
+
+void Decoder::DecodeSparseFile(istream& is, const fs::path& file_path, size_t num_of_extents)
+{
+	vector<SparseExtent> extents;
+	uint64_t file_size = ReadSparseExtents(is, num_of_extents, extents);
+	PreallocateFile(file_path, file_size, true);
+
+	ofstream os{ file_path, ios_base::in | ios_base::binary };
+
+	if (!os.good()) {
+		error_code ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "DecodeSparseFile", file_path, ec };
+	}
+
+	ExtentWriter extent_writer{ os, extents };
+	ostream extent_os{ &extent_writer };
+	Decode(is, extent_os, ReadHufHeader(is));
+	extent_os.flush();
+	if (extent_writer.size() != GetExtentsSize(extents))
+		throw runtime_error{ "Invalid file header: data size does not match the sparse extents" };
+}
+
+void DecodeSparseFile(istream& is, const fs::path& file_path, size_t num_of_extents)
+{
+	Decoder{}.DecodeSparseFile(is, file_path, num_of_extents);
+}
+
+void Decoder::DecodeDirectory(istream& is, const fs::path& prefix, size_t num_of_file)
+{
+	fs::create_directory(prefix);
+
+	for (size_t i = 0; i < num_of_file; i++)
+		DecompressEntry(is, prefix);
+}
+
+void DecodeDirectory(istream& is, const fs::path& prefix, size_t num_of_file)
+{
+	Decoder{}.DecodeDirectory(is, prefix, num_of_file);
+}
+
+struct SolidFile
+{
+	fs::path name;
+	size_t offset;
+	size_t size;
+};
+
+// return sum of the file sizes
+size_t Decoder::ReadSolidEntries(istream& is, size_t num_of_file)
+{
+	size_t offset = 0;
+	solid_files.clear();
+
+	for (size_t i = 0; i < num_of_file; i++) {
+		SolidEntry entry{};
+		if (!is.read((char*)&entry, sizeof(SolidEntry)) || entry.name_size >= FILENAME_MAX || !entry.name_size)
+			throw out_of_range{ "Invalid file header: Invalid solid entry" };
+
+		name.resize(entry.name_size);
+		is.read((char*)name.data(), sizeof(NameType) * entry.name_size);
+
+		solid_files.push_back({ name, offset, entry.data_size });
+		offset += entry.data_size;
+	}
+	return offset;
+}
+
+void Decoder::DecodeSolidBlock(istream& is, const fs::path& prefix, size_t num_of_file)
+{
+	size_t block_size = ReadSolidEntries(is, num_of_file);
+
+	ostringstream block_os;
+	Decode(is, block_os, ReadHufHeader(is));
+	if (block_os.tellp() != (streampos)block_size)
+		throw runtime_error{ "Invalid file header: solid block size does not match its entries" };
+	string block = block_os.str();
+
+	for (const auto& file : solid_files) {
+		ofstream os{ prefix / file.name, ios_base::binary };
+		if (!os.good()) {
+			error_code ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "DecodeSolidBlock", prefix / file.name, ec };
+		}
+		os.write(block.data() + file.offset, file.size);
+	}
+}
+
+void DecodeSolidBlock(istream& is, const fs::path& prefix, size_t num_of_file)
+{
+	Decoder{}.DecodeSolidBlock(is, prefix, num_of_file);
+}
+
+// the name is read into the buffer of the decoder, which the entries of a directory reuse
+void Decoder::ReadHeader(istream& is, Header& header)
+{
+	ReadEntryHeader(is, archive_version, header);
+
+	name.resize(header.name_size);
+	is.read((char*)name.data(), sizeof(NameType) * header.name_size);
+}
+
+fs::path Decoder::DecompressEntry(istream& is, const fs::path& prefix)
+{
+	Header header{};
+	ReadHeader(is, header);
+	fs::path entry_name = name;
+
+	switch (header.type) {
+	case TYPE_REGULAR_FILE:
+		if (header.data_size)
+			DecodeSparseFile(is, prefix / entry_name, header.data_size);
+		else
+			DecodeFile(is, prefix / entry_name);
+		break;
+	case TYPE_DIRECTORY:
+		DecodeDirectory(is, prefix / entry_name, header.data_size);
+		break;
+	case TYPE_SOLID_BLOCK:
+		DecodeSolidBlock(is, prefix, header.data_size);
+		break;
+	}
+	return entry_name;
+}
+
+fs::path Decoder::Decompress(istream& is, const fs::path& prefix)
+{
+	archive_version = ReadArchiveHeader(is);
+	return DecompressEntry(is, prefix);
+}
+
+void Decompress(istream& is, const fs::path& prefix)
+{
+	Decoder{}.Decompress(is, prefix);
+}
+
+fs::path DecompressRetFilename(istream& is, const fs::path& prefix)
+{
+	return Decoder{}.Decompress(is, prefix);
+}
+
+uint64_t SkipEncodedData(istream& is)
+{
+	HufHeader header = ReadHufHeader(is);
+	if (header.lz77)
+		return SkipLz77Data(is);
+	if (header.adaptive)
+		return SkipAdaptiveData(is);
+
+	is.seekg(GetEncodedSize(header), ios_base::cur);
+	return GetDecodedSize(header);
+}
+
+uint64_t Decoder::SkipFile(istream& is, const Header& header)
+{
+	// the old layout has no size, the data is decoded without writing it
+	if (archive_version == ARCHIVE_VERSION_LEGACY) {
+		NullBuffer null_buffer;
+		ostream null_os{ &null_buffer };
+		return DecodeLegacy(is, null_os);
+	}
+
+	if (!header.data_size)
+		return SkipEncodedData(is);
+
+	vector<SparseExtent> extents;
+	uint64_t file_size = ReadSparseExtents(is, header.data_size, extents);
+	SkipEncodedData(is);
+	return file_size;
+}
+
+uintmax_t Decoder::GetEntrySize(istream& is)
+{
+	Header header{};
+	ReadHeader(is, header);
+
+	uintmax_t size = 0;
+	switch (header.type) {
+	case TYPE_REGULAR_FILE:
+		size = SkipFile(is, header);
+		break;
+	case TYPE_DIRECTORY:
+		for (size_t i = 0; i < header.data_size; i++)
+			size += GetEntrySize(is);
+		break;
+	case TYPE_SOLID_BLOCK:
+		ReadSolidEntries(is, header.data_size);
+		size = SkipEncodedData(is);
+		break;
+	}
+	return size;
+}
+
+void Decoder::SkipEntry(istream& is)
+{
+	if (archive_version != ARCHIVE_VERSION_LEGACY) {
+		GetEntrySize(is);
+		return;
+	}
+
+	Header header{};
+	ReadHeader(is, header);
+	if (header.type == TYPE_DIRECTORY) {
+		for (size_t i = 0; i < header.data_size; i++)
+			SkipEntry(is);
+	}
+	else {
+		SkipLegacyData(is);
+	}
+}
+
+uintmax_t Decoder::GetDecompressedSize(istream& is)
+{
+	archive_version = ReadArchiveHeader(is);
+	return GetEntrySize(is);
+}
+
+uintmax_t GetDecompressedSize(istream& is)
+{
+	return Decoder{}.GetDecompressedSize(is);
+}
+
+fs::path Decoder::GetEntryName(istream& is)
+{
+	auto archive_pos = is.tellg();
+	archive_version = ReadArchiveHeader(is);
+	Header header{};
+	ReadHeader(is, header);
+	if (!is)
+		throw runtime_error{ "Invalid file header: name is truncated" };
+	is.seekg(archive_pos);
+	return name;
+}
+
+fs::path GetEntryName(istream& is)
+{
+	return Decoder{}.GetEntryName(is);
+}
+
+// mode: with ios_base::in, a preallocated file is written without truncating it
+static ofstream OpenOutputFile(const fs::path& file_path, ios_base::openmode mode = ios_base::binary)
+{
+	ofstream os{ file_path, mode };
+	if (!os.good()) {
+		error_code ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "ExtractEntry", file_path, ec };
+	}
+	return os;
+}
+
+// the parts of the range in the extents are decoded from the data, the rest is left as holes
+void Decoder::DecodeSparseRange(istream& is, const fs::path& file_path, size_t num_of_extents, size_t offset, size_t length)
+{
+	vector<SparseExtent> extents;
+	uint64_t file_size = ReadSparseExtents(is, num_of_extents, extents);
+	uint64_t first = min<uint64_t>(offset, file_size);
+	uint64_t last = first + min<uint64_t>(length, file_size - first);
+
+	PreallocateFile(file_path, last - first, true);
+	ofstream os = OpenOutputFile(file_path, ios_base::in | ios_base::binary);
+
+	// the parts of the extents in the range follow each other in the decoded data,
+	// so they are decoded at once and written to their places in the output file
+	vector<SparseExtent> parts;
+	uint64_t span_first = 0; // of the first part in the decoded data
+	uint64_t extent_pos = 0; // of the extent in the decoded data
+	for (const auto& extent : extents) {
+		uint64_t begin = max(first, extent.offset);
+		uint64_t end = min(last, extent.offset + extent.size);
+		if (begin < end) {
+			if (parts.empty())
+				span_first = extent_pos + (begin - extent.offset);
+			parts.push_back({ begin - first, end - begin });
+		}
+		extent_pos += extent.size;
+	}
+
+	auto header_pos = is.tellg();
+	if (!parts.empty()) {
+		HufHeader huf_header = ReadHufHeader(is);
+		ExtentWriter extent_writer{ os, parts };
+		ostream extent_os{ &extent_writer };
+		DecodeRange(is, extent_os, huf_header, span_first, GetExtentsSize(parts));
+		extent_os.flush();
+	}
+
+	is.seekg(header_pos);
+	SkipEncodedData(is);
+}
+
+fs::path Decoder::ExtractEntry(istream& is, fs::path::iterator first, fs::path::iterator last, const fs::path& prefix,
+							   size_t offset, size_t length)
+{
+	Header header{};
+	ReadHeader(is, header);
+
+	bool is_last = next(first) == last;
+	bool is_target = header.type != TYPE_SOLID_BLOCK && *first == name;
+	bool is_range = offset || length != numeric_limits<size_t>::max();
+
+	switch (header.type) {
+	case TYPE_REGULAR_FILE:
+		if (is_target && is_last) {
+			fs::path file_path = prefix / name;
+			if (archive_version == ARCHIVE_VERSION_LEGACY && is_range) {
+				throw invalid_argument{ "A range cannot be decoded from an archive of the old layout, which has no sizes" };
+			}
+			else if (header.data_size && is_range) {
+				DecodeSparseRange(is, file_path, header.data_size, offset, length);
+			}
+			else if (header.data_size) {
+				DecodeSparseFile(is, file_path, header.data_size);
+			}
+			else if (is_range) {
+				HufHeader huf_header = ReadHufHeader(is);
+				ofstream os = OpenOutputFile(file_path);
+				DecodeRange(is, os, huf_header, offset, length);
+			}
+			else {
+				DecodeFile(is, file_path);
+			}
+			return file_path;
+		}
+		if (archive_version == ARCHIVE_VERSION_LEGACY)
+			SkipLegacyData(is);
+		else
+			SkipFile(is, header);
+		return {};
+	case TYPE_DIRECTORY:
+		if (is_target && is_last) {
+			if (is_range)
+				throw invalid_argument{ "A range can only be decoded from a file" };
+			fs::path dir_path = prefix / name;
+			DecodeDirectory(is, dir_path, header.data_size);
+			return dir_path;
+		}
+		for (size_t i = 0; i < header.data_size; i++) {
+			if (is_target) {
+				fs::path result = ExtractEntry(is, next(first), last, prefix, offset, length);
+				if (!result.empty())
+					return result;
+			}
+			else {
+				SkipEntry(is);
+			}
+		}
+		return {};
+	case TYPE_SOLID_BLOCK: {
+		size_t block_size = ReadSolidEntries(is, header.data_size);
+
+		auto file = find_if(solid_files.begin(), solid_files.end(), [&](const SolidFile& f) { return f.name == *first; });
+		if (!is_last || file == solid_files.end()) {
+			SkipEncodedData(is);
+			return {};
+		}
+
+		HufHeader huf_header = ReadHufHeader(is);
+		if (HasDecodedSize(huf_header) && GetDecodedSize(huf_header) != block_size)
+			throw runtime_error{ "Invalid file header: solid block size does not match its entries" };
+
+		// only the part of the block holding the file
+		offset = min(offset, file->size);
+		fs::path file_path = prefix / file->name;
+		ofstream os = OpenOutputFile(file_path);
+		DecodeRange(is, os, huf_header, file->offset + offset, min(length, file->size - offset));
+		return file_path;
+	}
+	}
+	return {};
+}
+
+fs::path Decoder::ExtractEntry(istream& is, const fs::path& entry_path, const fs::path& prefix, size_t offset, size_t length)
+{
+	fs::path relative_path = entry_path.lexically_normal().relative_path();
+	archive_version = ReadArchiveHeader(is);
+
+	// the name of the first entry
+	if (relative_path.empty()) {
+		auto first_pos = is.tellg();
+		Header header{};
+		ReadHeader(is, header);
+		is.seekg(first_pos);
+		relative_path = name;
+	}
+
+	return ExtractEntry(is, relative_path.begin(), relative_path.end(), prefix, offset, length);
+}
+
+fs::path ExtractEntry(istream& is, const fs::path& entry_path, const fs::path& prefix, size_t offset, size_t length)
+{
+	return Decoder{}.ExtractEntry(is, entry_path, prefix, offset, length);
+}
+
 }
\ No newline at end of file
@@ -1,135 +1,504 @@
-#ifndef HUFFMAN_H
-#define HUFFMAN_H
-
-#include <stdint.h>
-#include <vector>
-#include <fstream>
-#include <filesystem>
-#include <limits>
-#include <bitset>
-
-#include "node.hpp"
-#include "huf_exception.hpp"
-
-#define TOKEN_MAX 0x100 // 1byte
-#define TOKEN_BITS 8
-
-#define TYPE_REGULAR_FILE 0
-#define TYPE_DIRECTORY 1
-
-namespace Huffman
-{
-
-struct TokenCount
-{
-	unsigned char token;
-	unsigned count;
-
-	bool operator<(const TokenCount& other) const
-	{
-		return count < other.count;
-	}
-	bool operator>(const TokenCount& other) const
-	{
-		return count > other.count;
-	}
-	bool operator==(const TokenCount& other) const
-	{
-		return count == other.count;
-	}
-	bool operator<=(const TokenCount& other) const
-	{
-		return count <= other.count;
-	}
-	bool operator>=(const TokenCount& other) const
-	{
-		return count >= other.count;
-	}
-	bool operator!=(const TokenCount& other) const
-	{
-		return count != other.count;
-	}
-};
-
-#pragma pack(push, 1)
-
-using token_t = uint8_t;
-
-struct HufHeader
-{
-	uint16_t padding_bits : 3;
-	uint16_t records_size : 13;
-	size_t data_size;
-};
-
-struct Header
-{
-	uint16_t type : 1;
-	uint16_t name_size : 15; // name is std::filesystem::path::value_type
-	size_t data_size;
-};
-
-using NameType = std::filesystem::path::value_type;
-
-using FileHeader = Header;
-using DirectoryHeader = Header;
-
-struct TokenRecord
-{
-	token_t level;
-	token_t token;
-};
-
-#pragma pack(pop)
-
-using HufNode = PODNode<TokenCount, 2>;
-//using Code = std::vector<bool>;
-
-struct Code
-{
-	std::bitset<TOKEN_MAX> code;
-	size_t size;
-};
-
-// preprocessing for encoding------------------------------
-std::vector<size_t> MakeTokenTable(std::istream& is);
-HufNode* MakePrefixTree(const std::vector<size_t>& token_table);
-std::vector<Code> MakeCodeTable(const HufNode* tree);
-uint16_t BuildTokenRecords(const HufNode* tree, TokenRecord token_records[]);
-
-// encoding process----------------------------------------
-
-// return last bit position + 1
-int ConvertToHufCode(std::istream& src, std::ostream& dst, const std::vector<Code>& code_table);
-
-void Encode(std::istream& src, std::ostream& dst, const std::vector<Code>& code_table, const HufNode* tree);
-
-void Encoding(std::istream& src, std::ostream& dst);
-
-void EncodeFile(const std::filesystem::path& file_path, std::ostream& dst);
-
-void EncodeDirectory(const std::filesystem::path& dir_path, std::ostream& dst);
-
-void Compress(const std::filesystem::path& src_path, std::ostream& dst);
-
-// decoding process----------------------------------------
-HufNode* DecodeTokenRecords(const TokenRecord token_records[], uint16_t records_size);
-
-void ConvertToToken(std::istream& src, std::ostream& dst, const HufNode* tree, int padding_bits, size_t max_len = std::numeric_limits<size_t>::max());
-
-void Decode(std::istream& src, std::ostream& dst);
-
-void Decoding(std::istream& src, std::ostream& dst);
-
-void DecodeFile(std::istream& src, const std::filesystem::path& prefix);
-
-void DecodeDirectory(std::istream& src, const std::filesystem::path& prefix, size_t num_of_file);
-
-void Decompress(std::istream& src, const std::filesystem::path& prefix);
-
-// н  ʹٸ ̰?!
-std::filesystem::path DecompressRetFilename(std::istream& src, const std::filesystem::path& prefix);
-
-}
-
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#include "node.hpp"
+#include "huf_exception.hpp"
+
+#define BYTE_BITS 8
+
+// width of the tokens, selectable per entry
+#define TOKEN_MODE_8 0 // 1byte
+#define TOKEN_MODE_16 1 // 2byte, little endian
+
+// longer codes are avoided by flattening the token counts
+#define MAX_CODE_LENGTH 32
+
+// an archive starts with ArchiveHeader. ARCHIVE_VERSION changes with the layout of the headers or the data,
+// so an archive of another layout is rejected instead of being misread
+#define ARCHIVE_MAGIC 0x4843524146465548ULL // "HUFFARCH"
+#define ARCHIVE_VERSION 1
+// an archive without ArchiveHeader, written before it: LegacyHeader and LegacyHufHeader instead, 8 bit tokens only
+#define ARCHIVE_VERSION_LEGACY 0
+// a stream of standard input starts with an ArchiveHeader of this magic, then the data of one Encoding without a name
+#define STREAM_MAGIC 0x4d52545346465548ULL // "HUFFSTRM"
+
+#define TYPE_REGULAR_FILE 0
+#define TYPE_DIRECTORY 1
+#define TYPE_SOLID_BLOCK 2
+
+// files smaller than SOLID_FILE_MAX are put together until the block reaches SOLID_BLOCK_MAX
+#define SOLID_FILE_MAX 0x10000 // 64KiB
+#define SOLID_BLOCK_MAX 0x400000 // 4MiB
+
+// a sync point (bit offset in the data) is recorded every SYNC_INTERVAL tokens
+#define SYNC_INTERVAL 0x100000 // 1MiB
+
+// encoding on threads: each thread counts and codes one chunk of the source at a time
+#define PARALLEL_CHUNK_SIZE 0x100000 // 1MiB
+// decoding on threads: each thread decodes a chunk of the data from its first bit, before the end of the chunk before
+// it is known. the decode usually falls on the right token boundaries within PARALLEL_SYNC_WINDOW bits, otherwise
+// the chunk is decoded again from the right bit
+#define PARALLEL_SYNC_WINDOW 0x10000 // 64Kibit
+
+// adaptive coding: a block holds at most ADAPTIVE_BLOCK_MAX bytes of the source,
+// and the counts are halved when their sum exceeds ADAPTIVE_COUNT_MAX
+#define ADAPTIVE_BLOCK_MAX 0x10000 // 64KiB
+// the first block holds at most ADAPTIVE_BLOCK_MIN bytes and each next one twice as many, up to ADAPTIVE_BLOCK_MAX,
+// so the counts are learned early in a short source instead of after a whole block coded with the starting counts
+#define ADAPTIVE_BLOCK_MIN 0x1000 // 4KiB
+#define ADAPTIVE_COUNT_MAX 0x400000
+// the tree is rebuilt after a block when the tokens since the last rebuild reach the tokens before it,
+// or token_max * ADAPTIVE_REBUILD_RATIO
+#define ADAPTIVE_REBUILD_RATIO 16
+
+namespace Huffman
+{
+
+class RecompressCache;
+class Checkpoint;
+class Encoder;
+struct ManifestEntry;
+using Manifest = std::vector<ManifestEntry>;
+
+template <typename Token>
+struct TokenCount
+{
+	Token token;
+	size_t count;
+
+	bool operator<(const TokenCount& other) const
+	{
+		return count < other.count;
+	}
+	bool operator>(const TokenCount& other) const
+	{
+		return count > other.count;
+	}
+	bool operator==(const TokenCount& other) const
+	{
+		return count == other.count;
+	}
+	bool operator<=(const TokenCount& other) const
+	{
+		return count <= other.count;
+	}
+	bool operator>=(const TokenCount& other) const
+	{
+		return count >= other.count;
+	}
+	bool operator!=(const TokenCount& other) const
+	{
+		return count != other.count;
+	}
+};
+
+#pragma pack(push, 1)
+
+using token_t = uint8_t;
+
+struct HufHeader
+{
+	uint8_t padding_bits : 3;
+	uint8_t token_mode : 1; // TOKEN_MODE_8 or TOKEN_MODE_16
+	uint8_t tail_padding : 1; // TOKEN_MODE_16: the last token has a zero byte that is not decoded
+	uint8_t adaptive : 1; // followed by adaptive blocks instead of records, sync points and data
+	uint8_t lz77 : 1; // followed by LZ77 blocks, see huf_lz77.hpp
+	uint8_t ans : 1; // TOKEN_MODE_8: ANS records and data instead of token records and codes, see huf_ans.hpp
+	uint32_t records_size;
+	size_t data_size;
+	size_t token_count; // number of tokens before encoding
+	uint32_t sync_interval; // 0: no sync points
+};
+
+// HufHeader, token records, sync points (uint64_t * GetNumOfSyncPoints), data
+// sync point k: bit offset of token (k + 1) * sync_interval in the data
+
+// adaptive: HufHeader (only token_mode is used), blocks, and a block with byte_count 0
+struct AdaptiveBlock
+{
+	uint32_t byte_count; // source bytes, followed by data_size bytes of data
+	uint32_t data_size;
+};
+
+struct Header
+{
+	uint16_t type : 2;
+	uint16_t name_size : 14; // name is std::filesystem::path::value_type, solid block has no name
+	size_t data_size; // directory, solid block: number of entries. file: number of extents of a sparse file, 0 if not sparse
+};
+
+// archive: ArchiveHeader, then one entry (Header, name, and its data or entries)
+struct ArchiveHeader
+{
+	uint64_t magic;
+	uint32_t version;
+};
+
+// ARCHIVE_VERSION_LEGACY: LegacyHeader, name, and a file has LegacyHufHeader, token records (Codec8::Record * records_size)
+// and data. the number of tokens is not stored, the codes end padding_bits before the end of the last byte
+struct LegacyHeader
+{
+	uint16_t type : 1;
+	uint16_t name_size : 15;
+	size_t data_size; // directory: number of entries
+};
+
+struct LegacyHufHeader
+{
+	uint16_t padding_bits : 3;
+	uint16_t records_size : 13;
+	size_t data_size;
+};
+
+using NameType = std::filesystem::path::value_type;
+
+using FileHeader = Header;
+using DirectoryHeader = Header;
+using SolidBlockHeader = Header;
+
+// solid block directory, followed by the data of all files encoded as one
+struct SolidEntry
+{
+	uint16_t name_size; // followed by name
+	size_t data_size; // size of the file
+};
+
+template <typename Token>
+struct TokenRecord
+{
+	uint8_t level;
+	Token token;
+};
+
+#pragma pack(pop)
+
+// code bit i is the i-th branch from the root
+struct Code
+{
+	uint32_t code;
+	uint32_t size;
+};
+
+// Compile-time parameters of the codec. Everything that depends on the token width is a constant here,
+// so each instantiation gets its own tables and loops without runtime checks.
+// The sizes of the tables are these constants, their contents are not: the code table and the tree come from
+// the token counts of each source, and the decoder walks the tree, so there is no fixed table to generate.
+template <typename Token, unsigned MaxCodeLength>
+struct Codec
+{
+	static_assert(std::is_unsigned_v<Token> && sizeof(Token) <= 2, "Token must be uint8_t or uint16_t");
+	static_assert(MaxCodeLength >= sizeof(Token) * BYTE_BITS && MaxCodeLength <= 32, "Code holds up to 32 bits");
+
+	using token_type = Token;
+	using Node = PODNode<TokenCount<Token>, 2>;
+	using Record = TokenRecord<Token>;
+
+	static constexpr unsigned token_bytes = sizeof(Token);
+	static constexpr size_t token_max = size_t(1) << (token_bytes * BYTE_BITS);
+	static constexpr unsigned max_code_length = MaxCodeLength;
+	static constexpr int token_mode = token_bytes == 1 ? TOKEN_MODE_8 : TOKEN_MODE_16;
+};
+
+using Codec8 = Codec<uint8_t, MAX_CODE_LENGTH>;
+using Codec16 = Codec<uint16_t, MAX_CODE_LENGTH>;
+
+using HufNode = Codec8::Node;
+
+// The templates are instantiated for Codec8 and Codec16 in huffman.cpp
+
+// preprocessing for encoding------------------------------
+
+// tail_padding: set if the last token was completed with a zero byte
+template <typename C>
+std::vector<size_t> MakeTokenTable(std::istream& is, bool* tail_padding = nullptr);
+
+template <typename C>
+typename C::Node* MakePrefixTree(const std::vector<size_t>& token_table);
+
+template <typename C>
+std::vector<Code> MakeCodeTable(const typename C::Node* tree);
+
+template <typename C>
+uint32_t BuildTokenRecords(const typename C::Node* tree, typename C::Record token_records[]);
+
+// encoding process----------------------------------------
+
+// return last bit position + 1
+// sync_points: if not null, the bit offset of every sync_interval-th token is appended to it
+template <typename C>
+int ConvertToHufCode(std::istream& src, std::ostream& dst, const std::vector<Code>& code_table,
+					 std::vector<uint64_t>* sync_points = nullptr, size_t sync_interval = 0);
+
+template <typename C>
+void Encode(std::istream& src, std::ostream& dst, const std::vector<Code>& code_table, const typename C::Node* tree,
+			size_t token_count, bool tail_padding);
+
+template <typename C>
+void Encoding(std::istream& src, std::ostream& dst);
+
+// one pass: the code table of each block is built from the counts of the tokens before it, and the decoder
+// rebuilds the same table, so nothing is stored but the blocks. a block is written as soon as it is read,
+// which is when AdaptiveCoder::block_max() bytes or all the bytes src has at the moment are read
+template <typename C>
+void EncodeAdaptive(std::istream& src, std::ostream& dst);
+
+// how the data of an entry is encoded
+struct EncodingOptions
+{
+	int token_mode = TOKEN_MODE_8;
+	bool adaptive = false; // EncodeAdaptive instead of Encoding
+	int lz77_level = 0; // if not 0, EncodeLz77 with this level
+	Encoder* encoder = nullptr; // if not null, its buffers are used instead of new ones
+	unsigned num_of_threads = 1; // Encoding of a seekable source: threads sharing one code table, the output does not change
+};
+
+// adaptive, LZ77: src is read once and can be a pipe
+void Encoding(std::istream& src, std::ostream& dst, const EncodingOptions& options);
+
+template <typename C>
+class CodecContext;
+
+// Keeps the tables, tree nodes and buffers of Encoding from one source to the next,
+// so encoding many small files does not allocate them for each file.
+// Compress uses one for all the files, a thread encoding in parallel needs its own.
+class Encoder
+{
+public:
+	Encoder();
+	~Encoder();
+
+	// same as Huffman::Encoding
+	void Encoding(std::istream& src, std::ostream& dst, const EncodingOptions& options = {});
+
+private:
+	// created when a source of the token width is first encoded
+	std::unique_ptr<CodecContext<Codec8>> context8;
+	std::unique_ptr<CodecContext<Codec16>> context16;
+};
+
+// Adaptive data one block at a time, for the callers that get the source or the data in pieces (huf_stream.hpp).
+// EncodeAdaptive and Decoder code the blocks with the same model.
+class AdaptiveCoder
+{
+public:
+	// encoding keeps the code table of the model, decoding only its tree
+	AdaptiveCoder(int token_mode, bool encoding);
+	~AdaptiveCoder();
+
+	// writes the AdaptiveBlock and the data of a block of at most ADAPTIVE_BLOCK_MAX bytes of the source
+	void EncodeBlock(std::ostream& dst, const std::string& block);
+
+	// bytes of the source for the next block, growing from ADAPTIVE_BLOCK_MIN
+	size_t block_max() const {
+		return next_block_max;
+	}
+
+	// src: right after the AdaptiveBlock. return the bytes of the block, valid until the next call
+	const std::string& DecodeBlock(std::istream& src, const AdaptiveBlock& block);
+
+private:
+	template <typename C>
+	struct State;
+
+	std::unique_ptr<State<Codec8>> state8;
+	std::unique_ptr<State<Codec16>> state16;
+	size_t next_block_max = ADAPTIVE_BLOCK_MIN;
+};
+
+struct CompressOptions : EncodingOptions
+{
+	RecompressCache* cache = nullptr; // if not null, unchanged files are copied from it instead of being encoded again
+	bool solid = false; // put small files of a directory together in solid blocks
+	Checkpoint* checkpoint = nullptr; // if not null, Compress goes on from it and saves it as the archive is written
+};
+
+void EncodeFile(const std::filesystem::path& file_path, std::ostream& dst, const CompressOptions& options = {});
+
+void EncodeSolidBlock(const std::vector<std::filesystem::path>& file_paths, std::ostream& dst, const CompressOptions& options = {});
+
+// the entry of the directory alone, Compress writes it after the ArchiveHeader
+void EncodeDirectory(const std::filesystem::path& dir_path, std::ostream& dst, const CompressOptions& options = {});
+
+void Compress(const std::filesystem::path& src_path, std::ostream& dst, const CompressOptions& options = {});
+
+// manifest: result of WalkPath
+// writes the ArchiveHeader first, unless options.checkpoint goes on from an archive that has it
+void Compress(const Manifest& manifest, std::ostream& dst, const CompressOptions& options = {});
+
+void WriteArchiveHeader(std::ostream& dst);
+
+// return the version of the archive, src is left at its first entry
+// an archive without the header is of ARCHIVE_VERSION_LEGACY, a newer version or a stream is not supported
+uint32_t ReadArchiveHeader(std::istream& src);
+
+void WriteStreamHeader(std::ostream& dst);
+
+// throws unless src starts with the header of a stream, read once so src can be a pipe
+void ReadStreamHeader(std::istream& src);
+
+// reads the header of an entry in an archive of the version, without the name
+void ReadEntryHeader(std::istream& src, uint32_t version, Header& header);
+
+// decoding process----------------------------------------
+template <typename C>
+typename C::Node* DecodeTokenRecords(const typename C::Record token_records[], uint32_t records_size);
+
+// reads up to data_size bytes and writes byte_count bytes of the decoded tokens
+// first_bit: bit position to start in the first byte, skip_count: number of bytes decoded but not written first
+template <typename C>
+void ConvertToToken(std::istream& src, std::ostream& dst, const typename C::Node* tree, size_t data_size, size_t byte_count,
+					int first_bit = 0, size_t skip_count = 0);
+
+HufHeader ReadHufHeader(std::istream& src);
+
+size_t GetNumOfSyncPoints(const HufHeader& header);
+
+// size of the data after decoding, in bytes. adaptive and LZ77 data have no size in the header
+uint64_t GetDecodedSize(const HufHeader& header);
+
+// bytes after the HufHeader of static data: token records, sync points and data
+uint64_t GetEncodedSize(const HufHeader& header);
+
+// return false for the last block
+bool ReadAdaptiveBlock(std::istream& src, AdaptiveBlock& block);
+
+// skips the data written by Encoding and returns its size after decoding
+uint64_t SkipEncodedData(std::istream& src);
+
+// decodes bytes [first, first + count) starting from the nearest sync point, src must be seekable
+// src: right after the HufHeader, left at the end of the data
+void DecodeRange(std::istream& src, std::ostream& dst, const HufHeader& header, size_t first, size_t count);
+
+void Decode(std::istream& src, std::ostream& dst, const HufHeader& header);
+
+void Decode(std::istream& src, std::ostream& dst);
+
+void Decoding(std::istream& src, std::ostream& dst);
+
+void DecodeFile(std::istream& src, const std::filesystem::path& prefix);
+
+void DecodeSparseFile(std::istream& src, const std::filesystem::path& file_path, size_t num_of_extents);
+
+void DecodeDirectory(std::istream& src, const std::filesystem::path& prefix, size_t num_of_file);
+
+void DecodeSolidBlock(std::istream& src, const std::filesystem::path& prefix, size_t num_of_file);
+
+// Decompress and the functions below read a whole archive, src at its ArchiveHeader
+void Decompress(std::istream& src, const std::filesystem::path& prefix);
+
+// 패스를 얻고 싶다면 이것?!
+std::filesystem::path DecompressRetFilename(std::istream& src, const std::filesystem::path& prefix);
+
+// reads only the headers of one entry and returns its size after decompression
+uintmax_t GetDecompressedSize(std::istream& src);
+
+// reads the header of the first entry and returns its name, empty for a solid block. src is left where it was
+std::filesystem::path GetEntryName(std::istream& src);
+
+// entry_path: path in the archive, starting with the name of the first entry. empty: the first entry
+// decodes only the entry (or the part of the solid block containing it) to prefix / entry name
+// [offset, offset + length): range of a file to decode, src must be seekable for a range
+// return the decoded path, or empty path if there is no such entry
+std::filesystem::path ExtractEntry(std::istream& src, const std::filesystem::path& entry_path, const std::filesystem::path& prefix,
+								   size_t offset = 0, size_t length = std::numeric_limits<size_t>::max());
+
+// Static data decoded from pieces given in order, with the tree walk of Decode (huf_stream.hpp)
+class DataDecoder
+{
+public:
+	// src: right after the HufHeader, the token records and sync points are read from it
+	DataDecoder(std::istream& src, const HufHeader& header);
+	~DataDecoder();
+
+	// data: the next bytes of the data, until all of them are given
+	// return false when all the bytes of the entry are written
+	// a tree of one token has no data, then each call writes up to 64KiB without data
+	bool Decode(const char* data, size_t size, std::ostream& dst);
+
+private:
+	template <typename C>
+	struct State;
+
+	std::unique_ptr<State<Codec8>> state8;
+	std::unique_ptr<State<Codec16>> state16;
+};
+
+struct SolidFile;
+
+// The decoding functions above as members, with the tree nodes, tables and buffers kept between entries
+// and one name buffer for all the headers. The functions above use a new Decoder for each call,
+// a thread decoding many sources keeps its own.
+class Decoder
+{
+public:
+	// num_of_threads: static data of more than PARALLEL_CHUNK_SIZE bytes is decoded on this many threads
+	explicit Decoder(unsigned num_of_threads = 1);
+	~Decoder();
+
+	void Decode(std::istream& src, std::ostream& dst, const HufHeader& header);
+
+	void DecodeRange(std::istream& src, std::ostream& dst, const HufHeader& header, size_t first, size_t count);
+
+	void DecodeFile(std::istream& src, const std::filesystem::path& file_path);
+
+	// src: at the LegacyHufHeader of a file, left at the end of its data. return the number of bytes written
+	// the data of more than PARALLEL_CHUNK_SIZE bytes is decoded on the threads too
+	uint64_t DecodeLegacy(std::istream& src, std::ostream& dst);
+
+	// src: right after the name, see huf_sparse.hpp. the holes are left unwritten
+	void DecodeSparseFile(std::istream& src, const std::filesystem::path& file_path, size_t num_of_extents);
+
+	void DecodeDirectory(std::istream& src, const std::filesystem::path& prefix, size_t num_of_file);
+
+	void DecodeSolidBlock(std::istream& src, const std::filesystem::path& prefix, size_t num_of_file);
+
+	// src: at the ArchiveHeader. return the name of the entry, empty for a solid block
+	std::filesystem::path Decompress(std::istream& src, const std::filesystem::path& prefix);
+
+	uintmax_t GetDecompressedSize(std::istream& src);
+
+	std::filesystem::path GetEntryName(std::istream& src);
+
+	std::filesystem::path ExtractEntry(std::istream& src, const std::filesystem::path& entry_path, const std::filesystem::path& prefix,
+									   size_t offset = 0, size_t length = std::numeric_limits<size_t>::max());
+
+private:
+	void ReadHeader(std::istream& src, Header& header);
+
+	// src: at the header of an entry, left at its end
+	std::filesystem::path DecompressEntry(std::istream& src, const std::filesystem::path& prefix);
+	uintmax_t GetEntrySize(std::istream& src);
+	// same as GetEntrySize without the size, so the data of the old layout is not decoded to count it
+	void SkipEntry(std::istream& src);
+
+	size_t ReadSolidEntries(std::istream& src, size_t num_of_file);
+
+	// src: right after the name, left at the end of the data
+	uint64_t SkipFile(std::istream& src, const Header& header);
+
+	void DecodeSparseRange(std::istream& src, const std::filesystem::path& file_path, size_t num_of_extents,
+						   size_t offset, size_t length);
+
+	std::filesystem::path ExtractEntry(std::istream& src, std::filesystem::path::iterator first, std::filesystem::path::iterator last,
+									   const std::filesystem::path& prefix, size_t offset, size_t length);
+
+	std::unique_ptr<CodecContext<Codec8>> context8;
+	std::unique_ptr<CodecContext<Codec16>> context16;
+	std::filesystem::path::string_type name; // of the last header, read before its entries
+	std::vector<SolidFile> solid_files; // of the last solid block
+	unsigned num_of_threads;
+	uint32_t archive_version = ARCHIVE_VERSION; // of the last archive read, the entries are read in its layout
+};
+
+}
+
 #endif // HUFFMAN_H
\ No newline at end of file
@@ -1,221 +1,842 @@
-#include <iostream>
-#include <fstream>
-#include <cstring>
-#include <filesystem>
-#include "huffman.hpp"
-
-// Messages
-
-#define ENTER_HELP "Enter '-h' as argument for help.\n"
-#define INVALID_ARG "Invalid argument received.\n" ENTER_HELP
-#define INVALID_OPTION_COMBINATION "Invalid option combination,\n" ENTER_HELP
-#define SAME_PATH "Source and destination cannot be the same.\n"
-#define FILE_IS_EMPTY "File is empty.\n"
-
-// Exit Code
-
-#define EC_GOOD 0
-#define EC_JUST_ERROR -1
-#define EC_INVALID_ARG -2
-#define EC_UNABLE_TO_OPEN_FILE -3
-#define EC_INVALID_OPTION_COMBINATION -4
-#define EC_SAME_PATH -5
-#define EC_EMPTY_FILE -6
-
-// Options
-#define ENCODE			01
-#define DECODE			02
-#define HELP			04
-#define PRINT_SIZE		010
-#define REMOVE_SOURCE	020
-
-using namespace std;
-namespace fs = std::filesystem;
-
-void PrintHelp();
-void PrintSize(const fs::path& src, const fs::path& dst);
-int FillOption(int& option, char str[]);
-
-int main(int argc, char* argv[])
-try {
-	int options = 0;
-
-	int i;
-	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
-		int err_code = FillOption(options, argv[i] + 1);
-		if (err_code != EC_GOOD)
-			return err_code;
-	}
-			
-
-	if (options & HELP) {
-		PrintHelp();
-		return EC_GOOD;
-	}
-
-	fs::path dst_path;
-
-	if (options & ENCODE) {
-		if (argc - i == 2) {
-			dst_path = argv[i + 1];
-			if (fs::is_directory(dst_path))
-				dst_path = dst_path / fs::path(argv[i]).filename().replace_extension("huf");
-		}
-		else if (argc - i == 1) {
-			dst_path = fs::path(argv[i]).replace_extension("huf");
-		}
-		else {
-			cerr << INVALID_ARG;
-			return EC_INVALID_ARG;
-		}
-
-		if (argv[i] == dst_path) {
-			cerr << SAME_PATH;
-			return EC_SAME_PATH;
-		}
-
-		ofstream os{ dst_path, ios_base::binary };
-		if (!os.good()) {
-			auto ec = make_error_code(huf_errc::invalid_fstream);
-			throw fs::filesystem_error{ "main", dst_path, ec };
-		}
-
-		Huffman::Compress(argv[i], os);
-		flush(os);
-	}
-	else if (options & DECODE) {
-		if (argc == i) {
-			cerr << INVALID_ARG;
-			return EC_INVALID_ARG;
-		}
-
-		ifstream is{ argv[i], ios_base::binary };
-		if (!is.good()) {
-			auto ec = make_error_code(huf_errc::invalid_fstream);
-			throw fs::filesystem_error{ "main", argv[i], ec };
-		}
-		else if (is.peek() == EOF) {
-			cerr << FILE_IS_EMPTY;
-			return EC_EMPTY_FILE;
-		}
-
-		dst_path = (argc - i == 2) ? argv[i + 1] : fs::path(argv[i]).parent_path();
-
-		if (argv[i] == dst_path) {
-			cerr << SAME_PATH;
-			return EC_SAME_PATH;
-		}
-
-		dst_path /= Huffman::DecompressRetFilename(is, dst_path);
-
-	}
-	else {
-		cerr << INVALID_ARG;
-		return EC_INVALID_ARG;
-	}
-
-	if (options & PRINT_SIZE)
-		PrintSize(argv[i], dst_path);
-
-	if (options & REMOVE_SOURCE)
-		fs::remove_all(argv[i]);
-
-	return EC_GOOD;
-}
-catch (fs::filesystem_error& e) {
-	cout << e.what() << endl;
-	return e.code().value();
-}
-catch (exception& e) {
-	cout << e.what() << endl;
-	return EC_JUST_ERROR;
-}
-catch (...) {
-	cout << "Unknown error";
-}
-
-void PrintHelp()
-{
-	cout << "usage: app_name [options] source [destination]\n"
-			"ex) huffman -e -s -r source.txt destination.huf\n"
-			"  options:\n"
-			"    All options are compared by first letter only\n"
-			"    -h  (help) print help. No source and destination input required.\n"
-			"    -e  (encode) Compress the source and save it to the destination.\n"
-			"    -d  (decode) Decompress the source and save it to the destination.\n"
-			"    -s  (size) Print the size of the source file and destination file.\n"
-			"    -r  (remove) Delete source file.\n"
-			"  source:\n"
-			"    Path to the target file to be compressed or decompressed.\n"
-			"    Cannot be the same as the destination\n"
-			"  destination:\n"
-			"    The path to the file in which to save the compressed or unpacked results.\n"
-			"    Cannot be the same as the source\n";
-}
-
-uintmax_t GetDirectorySize(const fs::path& dir_path)
-{
-	uintmax_t size = 0;
-	for (const auto& entry : fs::recursive_directory_iterator(dir_path))
-		size += entry.file_size();
-	
-	return size;
-}
-
-void PrintSize(const fs::path& src, const fs::path& dst)
-{
-	auto source_size = fs::is_directory(src) ? 
-		GetDirectorySize(src) : fs::file_size(src);
-	auto destination_size = fs::is_directory(dst) ? 
-		GetDirectorySize(dst) : fs::file_size(dst);
-	
-	cout << "source: " << source_size << "bytes, ";
-	cout << "destination: " << destination_size << "bytes, ";
-
-	if (source_size >= destination_size) {
-		cout << "decrease: " << source_size - destination_size << "bytes, ";
-		cout << (1 - (long double)destination_size / source_size) * 100 << '%';
-	}
-	else {
-		cout << "increase: " << destination_size - source_size << "bytes, ";
-		cout << ((long double)destination_size / source_size - 1) * 100 << '%';
-	}
-	cout << endl;
-}
-
-int FillOption(int& option, char str[])
-{
-	for (; *str; str++) {
-		switch (*str) {
-		case 'e':
-			if (option & (DECODE | HELP)) goto ERROR;
-			option |= ENCODE;
-			break;
-		case 'd':
-			if (option & (ENCODE | HELP)) goto ERROR;
-			option |= DECODE;
-			break;
-		case 'h':
-			if (option & (~HELP))  //& (ENCODE | DECODE | PRINT_SIZE | REMOVE_SOURCE))
-				goto ERROR;
-			option |= HELP;
-			break;
-		case 's':
-			if (option & HELP) goto ERROR;
-			option |= PRINT_SIZE;
-			break;
-		case 'r':
-			if (option & HELP) goto ERROR;
-			option |= REMOVE_SOURCE;
-			break;
-		default:
-			goto ERROR;
-		}
-	}
-
-	return EC_GOOD;
-
-ERROR:
-	cerr << INVALID_OPTION_COMBINATION;
-	return EC_INVALID_OPTION_COMBINATION;
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "huffman.hpp"
+#include "huf_cache.hpp"
+#include "huf_checkpoint.hpp"
+#include "huf_walker.hpp"
+#include "huf_server.hpp"
+#include "huf_lz77.hpp"
+#include "huf_search.hpp"
+
+// Messages
+
+#define ENTER_HELP "Enter '-h' as argument for help.\n"
+#define INVALID_ARG "Invalid argument received.\n" ENTER_HELP
+#define INVALID_OPTION_COMBINATION "Invalid option combination,\n" ENTER_HELP
+#define SAME_PATH "Source and destination cannot be the same.\n"
+#define FILE_IS_EMPTY "File is empty.\n"
+#define ENTRY_NOT_FOUND "No such entry in the archive.\n"
+#define BATCH_FAILED " of the sources failed.\n"
+
+// Exit Code
+
+#define EC_GOOD 0
+#define EC_JUST_ERROR -1
+#define EC_INVALID_ARG -2
+#define EC_UNABLE_TO_OPEN_FILE -3
+#define EC_INVALID_OPTION_COMBINATION -4
+#define EC_SAME_PATH -5
+#define EC_EMPTY_FILE -6
+#define EC_ENTRY_NOT_FOUND -7
+#define EC_BATCH_FAILED -8
+#define EC_NO_MATCH -9
+
+// Options
+#define ENCODE			01
+#define DECODE			02
+#define HELP			04
+#define PRINT_SIZE		010
+#define REMOVE_SOURCE	020
+#define INCREMENTAL		040
+#define SOLID			0100
+#define EXTRACT			0200
+#define CLIENT			0400
+#define SERVE			01000
+#define JOBS			02000
+#define MULTIPLE		04000
+#define LIST			010000
+#define NUL_LIST		020000
+#define RANGE			040000
+#define WIDE			0100000
+#define ADAPTIVE		0200000
+#define LZ77			0400000
+#define SEARCH			01000000
+#define CHECKPOINT		02000000
+
+// source and destination of the encoded data alone
+#define STREAM_PATH "-"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+void PrintHelp();
+uintmax_t GetPathSize(const fs::path& path);
+void PrintSize(ostream& os, uintmax_t source_size, uintmax_t destination_size);
+vector<fs::path> ReadPathList(const fs::path& list_path, char delim);
+string GetRequestOptions(const Huffman::CompressOptions& compress_options);
+int RunStream(int options, const Huffman::EncodingOptions& encoding_options, const fs::path& dst_path);
+int RunBatch(const vector<fs::path>& sources, int options, const Huffman::CompressOptions& compress_options,
+			 const fs::path& socket_path, unsigned num_of_jobs);
+int FillOption(int& option, char str[]);
+ofstream CreateNewFile(const fs::path& file_path);
+bool NextArg(int& i, int argc, char* argv[], fs::path& arg);
+bool NextArg(int& i, int argc, char* argv[], unsigned& arg);
+bool NextArg(int& i, int argc, char* argv[], size_t& arg);
+bool NextArg(int& i, int argc, char* argv[], string& arg);
+
+int main(int argc, char* argv[])
+try {
+	int options = 0;
+	fs::path cache_path;
+	fs::path journal_path;
+	fs::path entry_path;
+	fs::path socket_path;
+	fs::path list_path;
+	unsigned num_of_jobs = 0;
+	unsigned lz77_level = 0;
+	size_t range_offset = 0;
+	size_t range_length = 0;
+	string pattern;
+
+	int i;
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+		int prev_options = options;
+		int err_code = FillOption(options, argv[i] + 1);
+		if (err_code != EC_GOOD)
+			return err_code;
+
+		// options that take the next argument, in the order they are given
+		int new_options = options & ~prev_options;
+		if (((new_options & INCREMENTAL) && !NextArg(i, argc, argv, cache_path)) ||
+			((new_options & CHECKPOINT) && !NextArg(i, argc, argv, journal_path)) ||
+			((new_options & EXTRACT) && !NextArg(i, argc, argv, entry_path)) ||
+			((new_options & (CLIENT | SERVE)) && !NextArg(i, argc, argv, socket_path)) ||
+			((new_options & JOBS) && !NextArg(i, argc, argv, num_of_jobs)) ||
+			((new_options & LIST) && !NextArg(i, argc, argv, list_path)) ||
+			((new_options & RANGE) && !(NextArg(i, argc, argv, range_offset) && NextArg(i, argc, argv, range_length))) ||
+			((new_options & SEARCH) && !(NextArg(i, argc, argv, pattern) && !pattern.empty())) ||
+			((new_options & LZ77) && !(NextArg(i, argc, argv, lz77_level) && lz77_level >= 1 && lz77_level <= LZ77_LEVEL_MAX))) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+	}
+			
+
+	if (options & HELP) {
+		PrintHelp();
+		return EC_GOOD;
+	}
+
+	if (options & SEARCH) {
+		if (options != SEARCH) {
+			cerr << INVALID_OPTION_COMBINATION;
+			return EC_INVALID_OPTION_COMBINATION;
+		}
+		if (argc - i != 1) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+
+		ifstream is{ argv[i], ios_base::binary };
+		if (!is.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "main", argv[i], ec };
+		}
+
+		// path:offset of each match, like grep -b
+		size_t num_of_matches = 0;
+		Huffman::Search(is, pattern, [&](const Huffman::SearchMatch& match) {
+			cout << match.path.string() << ':' << match.offset << '\n';
+			num_of_matches++;
+		});
+		return num_of_matches ? EC_GOOD : EC_NO_MATCH;
+	}
+
+	if (options & SERVE) {
+		if (argc != i) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+		Huffman::RunServer(socket_path, num_of_jobs);
+		return EC_GOOD;
+	}
+
+	Huffman::CompressOptions compress_options;
+	compress_options.solid = options & SOLID;
+	compress_options.token_mode = (options & WIDE) ? TOKEN_MODE_16 : TOKEN_MODE_8;
+	compress_options.adaptive = options & ADAPTIVE;
+	compress_options.lz77_level = (options & LZ77) ? lz77_level : 0;
+
+	if (options & (MULTIPLE | LIST)) {
+		vector<fs::path> sources{ argv + i, argv + argc };
+		if (options & LIST) {
+			auto list = ReadPathList(list_path, (options & NUL_LIST) ? '\0' : '\n');
+			sources.insert(sources.end(), list.begin(), list.end());
+		}
+
+		if (!(options & (ENCODE | DECODE)) || sources.empty()) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+		return RunBatch(sources, options, compress_options, socket_path, num_of_jobs);
+	}
+
+	if (argc - i >= 1 && argv[i] == string{ STREAM_PATH }) {
+		// reading a pipe once needs adaptive coding or LZ77
+		bool has_other_options = options & ~(ENCODE | DECODE | WIDE | ADAPTIVE | LZ77);
+		if (has_other_options || ((options & ENCODE) && !(options & (ADAPTIVE | LZ77)))) {
+			cerr << INVALID_OPTION_COMBINATION;
+			return EC_INVALID_OPTION_COMBINATION;
+		}
+		if (!(options & (ENCODE | DECODE)) || argc - i > 2) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+		return RunStream(options, compress_options, (argc - i == 2) ? argv[i + 1] : STREAM_PATH);
+	}
+
+	fs::path dst_path;
+	uintmax_t source_size = 0;
+	uintmax_t decompressed_size = 0;
+
+	if (options & ENCODE) {
+		if (argc - i == 2) {
+			dst_path = argv[i + 1];
+			if (fs::is_directory(dst_path))
+				dst_path = dst_path / fs::path(argv[i]).filename().replace_extension("huf");
+		}
+		else if (argc - i == 1) {
+			dst_path = fs::path(argv[i]).replace_extension("huf");
+		}
+		else {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+
+		if (argv[i] == dst_path) {
+			cerr << SAME_PATH;
+			return EC_SAME_PATH;
+		}
+
+		if (options & CLIENT) {
+			Huffman::SendRequest(socket_path, GetRequestOptions(compress_options), fs::absolute(argv[i]), fs::absolute(dst_path));
+			source_size = (options & PRINT_SIZE) ? GetPathSize(argv[i]) : 0;
+		}
+		else {
+			unique_ptr<Huffman::RecompressCache> cache;
+			if (options & INCREMENTAL)
+				cache = make_unique<Huffman::RecompressCache>(cache_path);
+
+			compress_options.cache = cache.get();
+			compress_options.num_of_threads = num_of_jobs ? num_of_jobs : max(thread::hardware_concurrency(), 1u);
+
+			// the same walk is used for the size
+			Huffman::Manifest manifest = Huffman::WalkPath(argv[i]);
+			source_size = Huffman::GetManifestSize(manifest);
+
+			// the archive of an interrupted run is kept up to its last checkpoint and written on
+			unique_ptr<Huffman::Checkpoint> checkpoint;
+			bool resume = false;
+			if (options & CHECKPOINT) {
+				checkpoint = make_unique<Huffman::Checkpoint>(dst_path, journal_path);
+				resume = checkpoint->Load(manifest, compress_options);
+			}
+			compress_options.checkpoint = checkpoint.get();
+
+			ofstream os{ dst_path, resume ? ios_base::in | ios_base::out | ios_base::binary : ios_base::binary };
+			if (!os.good()) {
+				auto ec = make_error_code(huf_errc::invalid_fstream);
+				throw fs::filesystem_error{ "main", dst_path, ec };
+			}
+			if (resume)
+				os.seekp(0, ios_base::end);
+
+			Huffman::Compress(manifest, os, compress_options);
+			flush(os);
+
+			if (checkpoint)
+				checkpoint->Finish();
+			if (cache)
+				cache->Save();
+		}
+	}
+	else if (options & DECODE) {
+		if (argc == i) {
+			cerr << INVALID_ARG;
+			return EC_INVALID_ARG;
+		}
+
+		ifstream is{ argv[i], ios_base::binary };
+		if (!is.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "main", argv[i], ec };
+		}
+		else if (is.peek() == EOF) {
+			cerr << FILE_IS_EMPTY;
+			return EC_EMPTY_FILE;
+		}
+
+		dst_path = (argc - i == 2) ? argv[i + 1] : fs::path(argv[i]).parent_path();
+
+		if (argv[i] == dst_path) {
+			cerr << SAME_PATH;
+			return EC_SAME_PATH;
+		}
+
+		Huffman::Decoder decoder{ num_of_jobs ? num_of_jobs : max(thread::hardware_concurrency(), 1u) };
+
+		if (options & (EXTRACT | RANGE)) {
+			fs::path entry_dst_path = (options & RANGE) ?
+				decoder.ExtractEntry(is, entry_path, dst_path, range_offset, range_length) :
+				decoder.ExtractEntry(is, entry_path, dst_path);
+			if (entry_dst_path.empty()) {
+				cerr << ENTRY_NOT_FOUND;
+				return EC_ENTRY_NOT_FOUND;
+			}
+			dst_path = entry_dst_path;
+			decompressed_size = (options & PRINT_SIZE) ? GetPathSize(dst_path) : 0;
+		}
+		else {
+			// the size is recorded in the headers, so there is no need to walk the result
+			if (options & PRINT_SIZE) {
+				decompressed_size = Huffman::GetDecompressedSize(is);
+				is.seekg(0);
+			}
+
+			if (options & CLIENT)
+				dst_path = Huffman::SendRequest(socket_path, "d", fs::absolute(argv[i]), fs::absolute(dst_path));
+			else
+				dst_path /= decoder.Decompress(is, dst_path);
+		}
+
+	}
+	else if ((options & CLIENT) && argc == i) {
+		cout << Huffman::SendRequest(socket_path, "q") << endl;
+		return EC_GOOD;
+	}
+	else {
+		cerr << INVALID_ARG;
+		return EC_INVALID_ARG;
+	}
+
+	if (options & PRINT_SIZE) {
+		if (options & DECODE)
+			PrintSize(cout, GetPathSize(argv[i]), decompressed_size);
+		else
+			PrintSize(cout, source_size, GetPathSize(dst_path));
+	}
+
+	if (options & REMOVE_SOURCE)
+		fs::remove_all(argv[i]);
+
+	return EC_GOOD;
+}
+catch (fs::filesystem_error& e) {
+	cout << e.what() << endl;
+	return e.code().value();
+}
+catch (exception& e) {
+	cout << e.what() << endl;
+	return EC_JUST_ERROR;
+}
+catch (...) {
+	cout << "Unknown error";
+}
+
+void PrintHelp()
+{
+	cout << "usage: app_name [options] source [destination]\n"
+			"ex) huffman -e -s -r source.txt destination.huf\n"
+			"    huffman -e -i cache_dir source_dir destination.huf\n"
+			"    huffman -e -z 6 logs_dir\n"
+			"    huffman -e -k backup.journal data_dir backup.huf\n"
+			"    huffman -d -x source_dir/sub/file.txt source.huf destination_dir\n"
+			"    huffman -d -o 1048576 4096 source.log.huf\n"
+			"    huffman -g 'connection reset' logs.huf\n"
+			"    huffman -v /tmp/huffman.sock -j 4 &  huffman -c /tmp/huffman.sock -e source.txt\n"
+			"    huffman -e -m -j 8 a.log b.log c.log\n"
+			"    find logs -name '*.log' -print0 | huffman -e -0 -f /dev/stdin\n"
+			"    tail -f app.log | huffman -e -a - | ssh host 'huffman -d - app.log'\n"
+			"  options:\n"
+			"    All options are compared by first letter only\n"
+			"    -h  (help) print help. No source and destination input required.\n"
+			"    -e  (encode) Compress the source and save it to the destination.\n"
+			"    -d  (decode) Decompress the source and save it to the destination.\n"
+			"    -s  (size) Print the size of the source file and destination file.\n"
+			"    -r  (remove) Delete source file.\n"
+			"    -i  (incremental) Reuse the encoded data of unchanged files from the cache directory.\n"
+			"        The cache directory follows the option and is updated after compression.\n"
+			"    -k  (keep going) Save a journal to the file that follows the option while compressing a directory.\n"
+			"        Run again with the same journal after an interruption to go on from its last save.\n"
+			"    -b  (block) Compress small files of a directory together in solid blocks sharing one code table.\n"
+			"    -w  (wide) Compress 2-byte little endian tokens, for 16-bit samples. Decompression detects it.\n"
+			"    -a  (adaptive) Compress in one pass, updating the code table as the data is read.\n"
+			"        Each block is written as soon as it is read, without waiting for the end of the source.\n"
+			"    -z  (zip) Replace repeated strings with references before the Huffman coding.\n"
+			"        The level follows the option: 1 (fastest) ~ 9 (smallest).\n"
+			"    -x  (extract) Decompress only the entry whose path in the archive follows the option.\n"
+			"    -o  (offset) Decompress only the range of the file given by the next two arguments, offset and length.\n"
+			"        The file is the first entry, or the one given with -x.\n"
+			"    -v  (serve) Run as a server on the Unix domain socket that follows the option.\n"
+			"        No source and destination input required.\n"
+			"    -c  (client) Let the server on the socket that follows the option do -e or -d.\n"
+			"        Without source, print the statistics of the server.\n"
+			"    -j  (jobs) Number of worker threads, given as the next argument. Default: number of cores.\n"
+			"        With one source to -e, the threads encode each large file together, and with -d, decode it together.\n"
+			"    -m  (multiple) Every argument is a source, each result is saved next to its source.\n"
+			"        A failed source is reported and does not stop the others, and its partial result is removed.\n"
+			"        An existing result is not overwritten. Sources encoded to the same name keep their extension (x.txt.huf).\n"
+			"    -f  (file) Like -m, with sources read from the list file that follows the option, one per line.\n"
+			"    -0  Sources in the list file are separated by NUL instead of newline.\n"
+			"    -g  (grep) Print path:offset of every place in the files of the source archive where the string\n"
+			"        that follows the option appears, without decompressing them to disk. Only the source is given.\n"
+			"  source:\n"
+			"    Path to the target file to be compressed or decompressed.\n"
+			"    Cannot be the same as the destination\n"
+			"    '-': standard input, compressed (with -a) or decompressed without file names.\n"
+			"         The destination is a file, or standard output if it is '-' or omitted.\n"
+			"         Such a stream is only decompressed from '-', not as an archive.\n"
+			"  destination:\n"
+			"    The path to the file in which to save the compressed or unpacked results.\n"
+			"    Cannot be the same as the source\n";
+}
+
+uintmax_t GetPathSize(const fs::path& path)
+{
+	return Huffman::GetManifestSize(Huffman::WalkPath(path));
+}
+
+void PrintSize(ostream& os, uintmax_t source_size, uintmax_t destination_size)
+{
+	os << "source: " << source_size << "bytes, ";
+	os << "destination: " << destination_size << "bytes, ";
+
+	if (source_size >= destination_size) {
+		os << "decrease: " << source_size - destination_size << "bytes, ";
+		os << (1 - (long double)destination_size / source_size) * 100 << '%';
+	}
+	else {
+		os << "increase: " << destination_size - source_size << "bytes, ";
+		os << ((long double)destination_size / source_size - 1) * 100 << '%';
+	}
+	os << endl;
+}
+
+vector<fs::path> ReadPathList(const fs::path& list_path, char delim)
+{
+	ifstream is{ list_path, ios_base::binary };
+	if (!is.good()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "ReadPathList", list_path, ec };
+	}
+
+	vector<fs::path> paths;
+	string line;
+	while (getline(is, line, delim)) {
+		if (delim == '\n' && !line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			paths.push_back(line);
+	}
+	return paths;
+}
+
+// options of a compression request to the server
+string GetRequestOptions(const Huffman::CompressOptions& compress_options)
+{
+	string request_options = "e";
+	if (compress_options.solid)
+		request_options += 'b';
+	if (compress_options.token_mode == TOKEN_MODE_16)
+		request_options += 'w';
+	if (compress_options.adaptive)
+		request_options += 'a';
+	if (compress_options.lz77_level)
+		request_options += 'z' + to_string(compress_options.lz77_level);
+	return request_options;
+}
+
+int RunStream(int options, const Huffman::EncodingOptions& encoding_options, const fs::path& dst_path)
+{
+	// cin then reads what the pipe has instead of one byte at a time
+	ios_base::sync_with_stdio(false);
+
+	ofstream file;
+	if (dst_path != STREAM_PATH) {
+		file.open(dst_path, ios_base::binary);
+		if (!file.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "RunStream", dst_path, ec };
+		}
+	}
+	ostream& os = file.is_open() ? file : cout;
+
+	// the header keeps the stream from being read as an archive, which has names
+	if (options & ENCODE) {
+		Huffman::WriteStreamHeader(os);
+		Huffman::Encoding(cin, os, encoding_options);
+	}
+	else {
+		Huffman::ReadStreamHeader(cin);
+		Huffman::Decoding(cin, os);
+	}
+	os.flush();
+
+	return EC_GOOD;
+}
+
+// creates the file for writing, failing if it exists, so a result is never written over another
+ofstream CreateNewFile(const fs::path& file_path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (fd < 0)
+		throw fs::filesystem_error{ "CreateNewFile", file_path, error_code{ errno, generic_category() } };
+	close(fd);
+#else
+	if (fs::exists(file_path))
+		throw fs::filesystem_error{ "CreateNewFile", file_path, make_error_code(errc::file_exists) };
+#endif
+
+	ofstream os{ file_path, ios_base::binary };
+	if (!os.good()) {
+		auto ec = make_error_code(huf_errc::invalid_fstream);
+		throw fs::filesystem_error{ "CreateNewFile", file_path, ec };
+	}
+	return os;
+}
+
+// the result path of a source, read from the archive to decode. empty if it cannot be known before the source is processed
+fs::path GetBatchDestination(const fs::path& src, int options, Huffman::Decoder& decoder)
+{
+	if (options & ENCODE)
+		return fs::path(src).replace_extension("huf");
+
+	ifstream is{ src, ios_base::binary };
+	try {
+		fs::path entry_name = decoder.GetEntryName(is);
+		return entry_name.empty() ? fs::path{} : src.parent_path() / entry_name;
+	}
+	catch (exception&) {
+		return {};
+	}
+}
+
+// same as one source without destination. returns the result path
+// dst_path: result of GetBatchDestination, or the name given instead of it
+fs::path ProcessBatchItem(const fs::path& src, fs::path dst_path, int options, const Huffman::CompressOptions& compress_options,
+						  Huffman::Decoder& decoder, const fs::path& socket_path, ostream& message)
+{
+	uintmax_t source_size = 0;
+	uintmax_t destination_size = 0;
+
+	// do not leave a broken result behind. dst_path did not exist before, so only the result is removed
+	auto remove_result = [&]() {
+		error_code ec;
+		if (!dst_path.empty())
+			fs::remove_all(dst_path, ec);
+	};
+
+	if (options & ENCODE) {
+		if (src == dst_path)
+			throw invalid_argument{ "Source and destination cannot be the same." };
+
+		if (options & CLIENT) {
+			if (fs::exists(dst_path))
+				throw fs::filesystem_error{ "ProcessBatchItem", dst_path, make_error_code(errc::file_exists) };
+			try {
+				Huffman::SendRequest(socket_path, GetRequestOptions(compress_options), fs::absolute(src), fs::absolute(dst_path));
+			}
+			catch (...) {
+				remove_result();
+				throw;
+			}
+			source_size = (options & PRINT_SIZE) ? GetPathSize(src) : 0;
+		}
+		else {
+			ofstream os = CreateNewFile(dst_path);
+			try {
+				Huffman::Manifest manifest = Huffman::WalkPath(src);
+				source_size = Huffman::GetManifestSize(manifest);
+
+				Huffman::Compress(manifest, os, compress_options);
+			}
+			catch (...) {
+				os.close();
+				remove_result();
+				throw;
+			}
+		}
+		destination_size = (options & PRINT_SIZE) ? fs::file_size(dst_path) : 0;
+	}
+	else {
+		ifstream is{ src, ios_base::binary };
+		if (!is.good()) {
+			auto ec = make_error_code(huf_errc::invalid_fstream);
+			throw fs::filesystem_error{ "ProcessBatchItem", src, ec };
+		}
+		else if (is.peek() == EOF) {
+			throw runtime_error{ "File is empty." };
+		}
+
+		// the name of the entry is read first, so a failed decode is removed like a failed encode
+		fs::path entry_name = decoder.GetEntryName(is);
+		dst_path = entry_name.empty() ? fs::path{} : src.parent_path() / entry_name;
+		if (!dst_path.empty() && fs::exists(fs::symlink_status(dst_path)))
+			throw fs::filesystem_error{ "ProcessBatchItem", dst_path, make_error_code(errc::file_exists) };
+
+		if (options & PRINT_SIZE) {
+			source_size = fs::file_size(src);
+			destination_size = decoder.GetDecompressedSize(is);
+			is.seekg(0);
+		}
+
+		try {
+			if (options & CLIENT)
+				dst_path = Huffman::SendRequest(socket_path, "d", fs::absolute(src), fs::absolute(src).parent_path());
+			else
+				dst_path = src.parent_path() / decoder.Decompress(is, src.parent_path());
+		}
+		catch (...) {
+			remove_result();
+			throw;
+		}
+	}
+
+	message << src.string() << " -> " << dst_path.string() << endl;
+	if (options & PRINT_SIZE)
+		PrintSize(message, source_size, destination_size);
+
+	if (options & REMOVE_SOURCE)
+		fs::remove_all(src);
+
+	return dst_path;
+}
+
+int RunBatch(const vector<fs::path>& sources, int options, const Huffman::CompressOptions& compress_options,
+			 const fs::path& socket_path, unsigned num_of_jobs)
+{
+	atomic<size_t> next_source{ 0 };
+	atomic<size_t> num_of_failed{ 0 };
+	mutex output_mutex;
+
+	// two sources with the same result would write it at once and remove each other's source with -r.
+	// an encoded source is then named after its whole file name (x.txt.huf), the others fail before any work starts
+	vector<fs::path> destinations(sources.size());
+	vector<string> conflicts(sources.size());
+	{
+		Huffman::Decoder decoder;
+		for (size_t n = 0; n < sources.size(); n++)
+			destinations[n] = GetBatchDestination(sources[n], options, decoder);
+
+		auto count_claims = [&]() {
+			map<fs::path, size_t> claims;
+			for (const auto& dst_path : destinations) {
+				if (!dst_path.empty())
+					claims[fs::absolute(dst_path).lexically_normal()]++;
+			}
+			return claims;
+		};
+		auto is_claimed_twice = [](const map<fs::path, size_t>& claims, const fs::path& dst_path) {
+			return !dst_path.empty() && claims.at(fs::absolute(dst_path).lexically_normal()) > 1;
+		};
+
+		if (options & ENCODE) {
+			auto claims = count_claims();
+			for (size_t n = 0; n < sources.size(); n++) {
+				if (is_claimed_twice(claims, destinations[n]))
+					destinations[n] = fs::path(sources[n]) += ".huf";
+			}
+		}
+
+		auto claims = count_claims();
+		for (size_t n = 0; n < sources.size(); n++) {
+			if (is_claimed_twice(claims, destinations[n]))
+				conflicts[n] = "Another source has the same destination: " + destinations[n].string();
+		}
+	}
+
+	auto worker = [&]() {
+		// the buffers are kept for all the sources of the thread
+		Huffman::Encoder encoder;
+		Huffman::Decoder decoder;
+		Huffman::CompressOptions worker_options = compress_options;
+		worker_options.encoder = &encoder;
+
+		for (size_t n; (n = next_source++) < sources.size();) {
+			ostringstream message;
+			bool good = true;
+			try {
+				if (!conflicts[n].empty())
+					throw invalid_argument{ conflicts[n] };
+				ProcessBatchItem(sources[n], destinations[n], options, worker_options, decoder, socket_path, message);
+			}
+			catch (exception& e) {
+				good = false;
+				num_of_failed++;
+				message.str("");
+				message << sources[n].string() << ": " << e.what() << endl;
+			}
+
+			lock_guard<mutex> lock{ output_mutex };
+			(good ? cout : cerr) << message.str();
+		}
+	};
+
+	if (!num_of_jobs)
+		num_of_jobs = max(thread::hardware_concurrency(), 1u);
+	num_of_jobs = (unsigned)min<size_t>(num_of_jobs, sources.size());
+
+	vector<thread> threads;
+	for (unsigned i = 1; i < num_of_jobs; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& t : threads)
+		t.join();
+
+	if (num_of_failed) {
+		cerr << num_of_failed << BATCH_FAILED;
+		return EC_BATCH_FAILED;
+	}
+	return EC_GOOD;
+}
+
+int FillOption(int& option, char str[])
+{
+	for (; *str; str++) {
+		switch (*str) {
+		case 'e':
+			if (option & (DECODE | HELP | EXTRACT | SERVE | RANGE)) goto ERROR;
+			option |= ENCODE;
+			break;
+		case 'd':
+			if (option & (ENCODE | HELP | INCREMENTAL | CHECKPOINT | SOLID | SERVE | WIDE | ADAPTIVE | LZ77)) goto ERROR;
+			option |= DECODE;
+			break;
+		case 'h':
+			if (option & (~HELP))  //& (ENCODE | DECODE | PRINT_SIZE | REMOVE_SOURCE))
+				goto ERROR;
+			option |= HELP;
+			break;
+		case 's':
+			if (option & (HELP | SERVE)) goto ERROR;
+			option |= PRINT_SIZE;
+			break;
+		case 'r':
+			if (option & (HELP | SERVE)) goto ERROR;
+			option |= REMOVE_SOURCE;
+			break;
+		case 'i':
+			if (option & (DECODE | HELP | INCREMENTAL | CLIENT | SERVE | MULTIPLE | LIST)) goto ERROR;
+			option |= INCREMENTAL;
+			break;
+		case 'k':
+			if (option & (DECODE | HELP | CHECKPOINT | CLIENT | SERVE | MULTIPLE | LIST)) goto ERROR;
+			option |= CHECKPOINT;
+			break;
+		case 'b':
+			if (option & (DECODE | HELP | SERVE)) goto ERROR;
+			option |= SOLID;
+			break;
+		case 'a':
+			if (option & (DECODE | HELP | SERVE | LZ77)) goto ERROR;
+			option |= ADAPTIVE;
+			break;
+		case 'w':
+			if (option & (DECODE | HELP | SERVE | LZ77)) goto ERROR;
+			option |= WIDE;
+			break;
+		case 'z':
+			if (option & (DECODE | HELP | SERVE | WIDE | ADAPTIVE | LZ77)) goto ERROR;
+			option |= LZ77;
+			break;
+		case 'x':
+			if (option & (ENCODE | HELP | EXTRACT | CLIENT | SERVE | MULTIPLE | LIST)) goto ERROR;
+			option |= EXTRACT;
+			break;
+		case 'c':
+			if (option & (HELP | INCREMENTAL | CHECKPOINT | EXTRACT | CLIENT | SERVE | RANGE)) goto ERROR;
+			option |= CLIENT;
+			break;
+		case 'v':
+			if (option & ~JOBS) goto ERROR;
+			option |= SERVE;
+			break;
+		case 'j':
+			if (option & (HELP | JOBS)) goto ERROR;
+			option |= JOBS;
+			break;
+		case 'm':
+			if (option & (HELP | INCREMENTAL | CHECKPOINT | EXTRACT | SERVE | RANGE)) goto ERROR;
+			option |= MULTIPLE;
+			break;
+		case 'f':
+			if (option & (HELP | INCREMENTAL | CHECKPOINT | EXTRACT | SERVE | LIST | RANGE)) goto ERROR;
+			option |= LIST;
+			break;
+		case 'o':
+			if (option & (ENCODE | HELP | CLIENT | SERVE | MULTIPLE | LIST | RANGE)) goto ERROR;
+			option |= RANGE;
+			break;
+		case '0':
+			if (option & (HELP | SERVE)) goto ERROR;
+			option |= NUL_LIST;
+			break;
+		case 'g':
+			if (option) goto ERROR;
+			option |= SEARCH;
+			break;
+		default:
+			goto ERROR;
+		}
+	}
+
+	return EC_GOOD;
+
+ERROR:
+	cerr << INVALID_OPTION_COMBINATION;
+	return EC_INVALID_OPTION_COMBINATION;
+}
+
+bool NextArg(int& i, int argc, char* argv[], fs::path& arg)
+{
+	if (i + 1 == argc)
+		return false;
+
+	arg = argv[++i];
+	return true;
+}
+
+bool NextArg(int& i, int argc, char* argv[], string& arg)
+{
+	if (i + 1 == argc)
+		return false;
+
+	arg = argv[++i];
+	return true;
+}
+
+bool NextArg(int& i, int argc, char* argv[], unsigned& arg)
+{
+	size_t value;
+	if (!NextArg(i, argc, argv, value) || value > numeric_limits<unsigned>::max())
+		return false;
+
+	arg = (unsigned)value;
+	return true;
+}
+
+bool NextArg(int& i, int argc, char* argv[], size_t& arg)
+{
+	if (i + 1 == argc)
+		return false;
+
+	char* end;
+	arg = strtoull(argv[++i], &end, 10);
+	return *argv[i] && !*end;
 }
\ No newline at end of file